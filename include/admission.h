@@ -0,0 +1,79 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include "client_table.h"
+#include "order.h"
+
+enum class OverloadPolicy {
+    REJECT,  // THROTTLED as soon as a bound is hit
+    BLOCK    // the submitting thread waits up to max_block for room, then THROTTLED
+};
+
+struct AdmissionConfig {
+    size_t  max_symbol_queue = 65536;     // requests waiting on one symbol's strand
+    size_t  cancel_headroom = 8192;       // room above that only cancels may use
+    int64_t max_client_inflight = 16384;  // submitted but not yet completed, per client
+    double  client_rate = std::numeric_limits<double>::infinity();  // new orders and modifies per second
+    double  client_burst = 1000;          // token bucket depth
+    OverloadPolicy policy = OverloadPolicy::REJECT;
+    std::chrono::microseconds max_block{100000};
+    size_t  max_clients = 4096;           // clients tracked at once; idle ones give up their slot
+};
+
+struct ClientRate {
+    double rate = std::numeric_limits<double>::infinity();
+    double burst = 1000;
+};
+
+// Per-client ingress limits, checked before a request reaches a strand. The
+// token bucket is kept as GCRA: one theoretical arrival time per client, so
+// taking a token is a single CAS. As in RiskManager, clients live in a
+// ClientTable and nothing takes a lock. A client with nothing in flight, a
+// full bucket and the default rate gives up its slot to the next new one; a
+// client that finds no slot at all is throttled until one frees up.
+class AdmissionControl {
+public:
+    explicit AdmissionControl(AdmissionConfig config = {});
+
+    const AdmissionConfig& config() const { return config_; }
+    // false when the table has no room for the client
+    bool setClientRate(const ClientId& client, const ClientRate& rate);
+
+    // One token at now_ns (any monotonic nanosecond clock); false when the
+    // client is over its rate
+    bool takeToken(const ClientId& client, int64_t now_ns);
+    // Counts a request in flight; false when the client is at its bound
+    bool enter(const ClientId& client);
+    void leave(const ClientId& client);
+    int64_t inflight(const ClientId& client);
+
+    // Keeps a logged-on client's slot until it logs off; false when full
+    bool pin(const ClientId& client) { return table_.pin(client); }
+    void unpin(const ClientId& client) { table_.unpin(client); }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> key{0};  // 0 = free
+        std::atomic<int64_t>  users{0};
+        std::atomic<bool>     explicit_rate{false};
+        std::atomic<int64_t>  interval_ns{0};   // 1 / rate; 0 = unlimited, -1 = none allowed
+        std::atomic<int64_t>  tolerance_ns{0};  // how far ahead of now the bucket may run
+        std::atomic<int64_t>  tat_ns{0};        // theoretical arrival time
+        std::atomic<int64_t>  inflight{0};
+    };
+
+    static void storeRate(Slot& slot, const ClientRate& rate);
+
+    AdmissionConfig config_;
+    // A recent now_ns from takeToken, advanced at most once a millisecond; a
+    // bucket whose arrival time is behind it is full
+    alignas(64) std::atomic<int64_t> recentNs_{0};
+    ClientTable<Slot> table_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "order.h"
+
+// How an incoming order's quantity is split across the resting orders of one
+// price level. Levels are still taken best price first under every policy.
+enum class MatchingPolicy : uint8_t {
+    FIFO,      // price-time
+    PRO_RATA,  // in proportion to resting size
+    HYBRID     // a FIFO share first, the rest pro rata
+};
+
+struct AllocationRules {
+    MatchingPolicy policy = MatchingPolicy::FIFO;
+    // The order that set the current best price fills first, up to
+    // top_order_cap, while it is still at the front of its level
+    bool top_order_priority = true;
+    Qty top_order_cap = std::numeric_limits<Qty>::max();
+    // Pro-rata shares below this are dropped and go to the FIFO remainder
+    Qty min_allocation = 1;
+    double fifo_share = 0.4;  // HYBRID only
+};
+
+// Allocation policies. match_against_book is instantiated once per policy;
+// those with kLevelAllocation fill the orders of a level that the incoming
+// order cannot sweep whole from allocate(). Each works on the level's
+// visible quantities in time order: residual is what each order can still
+// take and is consumed, out receives the allocation.
+namespace allocation {
+
+// Up to amount into residual's orders in time order; returns what is left
+Qty fifo(Qty* residual, Qty* out, size_t n, Qty amount);
+
+// Shares of amount in proportion to residual, in one branch-free pass that
+// the compiler vectorizes. Each share is floor(residual * amount / total),
+// found with a 32.32 fixed point ratio instead of a division per order and
+// without floating point. Returns what rounding and min_allocation left
+// over; callers hand that out FIFO.
+Qty pro_rata(Qty* residual, Qty* out, size_t n, Qty amount, Qty min_allocation);
+
+} // namespace allocation
+
+struct FifoAllocation {
+    static constexpr MatchingPolicy kPolicy = MatchingPolicy::FIFO;
+    static constexpr bool kLevelAllocation = false;
+};
+
+struct ProRataAllocation {
+    static constexpr MatchingPolicy kPolicy = MatchingPolicy::PRO_RATA;
+    static constexpr bool kLevelAllocation = true;
+    // amount is less than the level's total
+    static void allocate(const AllocationRules& rules, bool top_order, Qty amount, Qty* residual, Qty* out, size_t n);
+};
+
+struct HybridAllocation {
+    static constexpr MatchingPolicy kPolicy = MatchingPolicy::HYBRID;
+    static constexpr bool kLevelAllocation = true;
+    static void allocate(const AllocationRules& rules, bool top_order, Qty amount, Qty* residual, Qty* out, size_t n);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef CLIENT_TABLE_H
+#define CLIENT_TABLE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "order.h"
+
+// Per-client state shared by every strand: a fixed open-addressed table of
+// cache-line slots keyed by a hash of the client id. Lookups, lazy
+// registration and counter updates are plain atomics. A client seen for the
+// first time claims a free slot within kWindow probes of its hash, or
+// reclaims one whose client left nothing behind (Slot::idle), so the table
+// only has to hold the clients active at once and a lookup never probes
+// further than the window.
+//
+// Slot needs std::atomic<uint64_t> key and std::atomic<int64_t> users. Every
+// use of a slot holds a Ref, which counts in users; so does a pinned client.
+// A slot with users is never reclaimed.
+template<class Slot>
+class ClientTable {
+public:
+    static constexpr size_t kWindow = 64;
+
+    class Ref {
+    public:
+        Ref() = default;
+        explicit Ref(Slot* slot) : slot_(slot) {}
+        Ref(Ref&& other) noexcept : slot_(std::exchange(other.slot_, nullptr)) {}
+        Ref& operator=(Ref&& other) noexcept {
+            std::swap(slot_, other.slot_);
+            return *this;
+        }
+        ~Ref() {
+            if (slot_) slot_->users.fetch_sub(1, std::memory_order_release);
+        }
+
+        explicit operator bool() const { return slot_ != nullptr; }
+        Slot* operator->() const { return slot_; }
+        Slot& operator*() const { return *slot_; }
+
+    private:
+        Slot* slot_{nullptr};
+    };
+
+    // init(slot) prepares a slot for a new client; idle(slot) says whether
+    // its client may be forgotten
+    ClientTable(size_t capacity, std::function<void(Slot&)> init, std::function<bool(const Slot&)> idle)
+        : slots_(std::make_unique<Slot[]>(std::bit_ceil(std::max<size_t>(capacity, 1)))),
+          mask_(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1),
+          init_(std::move(init)),
+          idle_(std::move(idle)) {}
+
+    // The client's slot, claimed if need be; empty when every slot in its
+    // window is in use
+    Ref acquire(const ClientId& client);
+    // The client's slot if it has one
+    Ref find(const ClientId& client);
+
+    // Keeps the client's slot from being reclaimed until unpin; false when
+    // it could not get one
+    bool pin(const ClientId& client) {
+        Ref ref = acquire(client);
+        if (ref) ref->users.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<bool>(ref);
+    }
+    void unpin(const ClientId& client) {
+        if (Ref ref = find(client)) ref->users.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static constexpr uint64_t kFree = 0;
+    static constexpr uint64_t kClaiming = 1;
+
+    static uint64_t keyFor(const ClientId& client) {
+        uint64_t key = std::hash<ClientId>{}(client);
+        return key > kClaiming ? key : key + 2;
+    }
+
+    size_t window() const { return std::min(kWindow, mask_ + 1); }
+    // Waits out a claim in progress
+    static uint64_t settledKey(const Slot& slot) {
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        while (current == kClaiming) {
+            std::this_thread::yield();
+            current = slot.key.load(std::memory_order_acquire);
+        }
+        return current;
+    }
+    // Counts a use, then checks the slot still belongs to key; pairs with
+    // the reclaimer taking the key before it reads users
+    static Ref use(Slot& slot, uint64_t key) {
+        slot.users.fetch_add(1, std::memory_order_seq_cst);
+        if (slot.key.load(std::memory_order_seq_cst) == key) return Ref(&slot);
+        slot.users.fetch_sub(1, std::memory_order_release);
+        return {};
+    }
+    Ref claim(Slot& slot, uint64_t key) {
+        init_(slot);
+        slot.users.fetch_add(1, std::memory_order_relaxed);
+        slot.key.store(key, std::memory_order_release);
+        return Ref(&slot);
+    }
+    Ref reclaim(uint64_t key);
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::function<void(Slot&)> init_;
+    std::function<bool(const Slot&)> idle_;
+    std::mutex reclaimMutex_;  // one reclaimer at a time, so a client never lands in two slots
+};
+
+template<class Slot>
+typename ClientTable<Slot>::Ref ClientTable<Slot>::acquire(const ClientId& client) {
+    uint64_t key = keyFor(client);
+    for (size_t probe = 0; probe < window(); ++probe) {
+        Slot& slot = slots_[(key + probe) & mask_];
+        uint64_t current = settledKey(slot);
+        if (current == key) {
+            if (Ref ref = use(slot, key)) return ref;
+            return reclaim(key);  // taken from under us; settle it under the lock
+        }
+        if (current != kFree) continue;
+
+        uint64_t expected = kFree;
+        if (slot.key.compare_exchange_strong(expected, kClaiming, std::memory_order_acq_rel)) {
+            return claim(slot, key);
+        }
+        // Lost the race; see whether the winner was the same client
+        if (settledKey(slot) == key) {
+            if (Ref ref = use(slot, key)) return ref;
+        }
+    }
+    return reclaim(key);
+}
+
+template<class Slot>
+typename ClientTable<Slot>::Ref ClientTable<Slot>::find(const ClientId& client) {
+    uint64_t key = keyFor(client);
+    for (size_t probe = 0; probe < window(); ++probe) {
+        Slot& slot = slots_[(key + probe) & mask_];
+        uint64_t current = settledKey(slot);
+        if (current == key) return use(slot, key);
+        if (current == kFree) break;
+    }
+    return {};
+}
+
+template<class Slot>
+typename ClientTable<Slot>::Ref ClientTable<Slot>::reclaim(uint64_t key) {
+    // Slow path: the window is full. Slots are never freed, only handed from
+    // an idle client to a new one, so probe chains stay intact.
+    std::lock_guard<std::mutex> lock(reclaimMutex_);
+    for (size_t probe = 0; probe < window(); ++probe) {
+        Slot& slot = slots_[(key + probe) & mask_];
+        uint64_t current = settledKey(slot);
+        if (current == key) {
+            if (Ref ref = use(slot, key)) return ref;
+        } else if (current == kFree) {
+            uint64_t expected = kFree;
+            if (slot.key.compare_exchange_strong(expected, kClaiming, std::memory_order_acq_rel)) return claim(slot, key);
+        }
+    }
+    for (size_t probe = 0; probe < window(); ++probe) {
+        Slot& slot = slots_[(key + probe) & mask_];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current <= kClaiming || slot.users.load(std::memory_order_acquire) != 0 || !idle_(slot)) continue;
+        if (!slot.key.compare_exchange_strong(current, kClaiming, std::memory_order_seq_cst)) continue;
+        if (slot.users.load(std::memory_order_seq_cst) != 0 || !idle_(slot)) {
+            // In use after all: give it back
+            slot.key.store(current, std::memory_order_release);
+            continue;
+        }
+        return claim(slot, key);
+    }
+    return {};
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <limits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Event timestamps are raw counter ticks: the invariant TSC where the CPU
+// has one, steady_clock nanoseconds otherwise. Reading one is a single
+// rdtsc; turning it into wall-clock time needs the calibration below and is
+// left to the formatting/decoding side.
+struct Timestamp {
+    uint64_t ticks{};
+
+    static constexpr Timestamp max() { return Timestamp{std::numeric_limits<uint64_t>::max()}; }
+    auto operator<=>(const Timestamp&) const = default;
+};
+
+class Clock {
+public:
+    static Timestamp now() {
+#if defined(__x86_64__) || defined(__i386__)
+        if (useTsc_) return Timestamp{__rdtsc()};
+#endif
+        return Timestamp{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count())};
+    }
+
+    // Pair a counter reading with CLOCK_REALTIME. Runs once at startup; the
+    // conversions below refresh it when the last pairing is over a second old.
+    static void calibrate();
+
+    static int64_t toWallNanos(Timestamp ts);
+    static Timestamp fromWallNanos(int64_t wall_ns);
+    // Monotonic nanoseconds on the counter's own origin, for deadlines and
+    // rate limits. Uses the startup rate only, so the same timestamp always
+    // maps to the same value however often calibrate() runs afterwards.
+    static uint64_t toNanos(Timestamp ts);
+    static uint64_t ticksFor(std::chrono::nanoseconds d);
+
+private:
+    struct Calibration {
+        uint64_t base_ticks;
+        int64_t  base_wall_ns;
+        double   ns_per_tick;
+    };
+
+    // Seqlock-published so readers on any thread never block the calibrator
+    static Calibration current();
+
+    static bool useTsc_;
+    static std::atomic<uint64_t> seq_;
+    static std::atomic<uint64_t> baseTicks_;
+    static std::atomic<int64_t>  baseWallNs_;
+    static std::atomic<double>   nsPerTick_;
+    static std::atomic<double>   durationNsPerTick_;  // set once, at startup
+};
+
+inline Timestamp operator+(Timestamp ts, std::chrono::nanoseconds d) {
+    return Timestamp{ts.ticks + Clock::ticksFor(d)};
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CSV_LOADER_H
+#define CSV_LOADER_H
+
+#include <string>
+#include <thread>
+#include <vector>
+#include "request_api.h"
+
+struct LoadedRequest {
+    SymbolId symbol;
+    TradingRequest request;
+};
+
+struct LoadResult {
+    std::vector<LoadedRequest> requests;
+    size_t bytes{0};
+    size_t bad_rows{0};   // malformed, unknown action or order type
+    double seconds{0};
+
+    double mbPerSecond() const { return seconds > 0 ? static_cast<double>(bytes) / 1e6 / seconds : 0.0; }
+};
+
+// Loads order flow CSVs (action,order_type,side,price,quantity,order_id) into
+// ready-to-submit requests. The file is mmapped and cut into one chunk per
+// thread on line boundaries; each chunk is parsed with std::from_chars, with
+// symbol and order type already resolved to ids. ADD rows without an
+// order_id get their 1-based data row number, which is what CANCEL rows in
+// the simulation files refer to.
+class CsvLoader {
+public:
+    struct Options {
+        Symb symbol;
+        SymbolId symbol_id{0};
+        ClientId client{"csv"};
+        size_t threads{std::thread::hardware_concurrency()};
+    };
+
+    explicit CsvLoader(Options options) : options_(std::move(options)) {}
+
+    // Throws std::system_error if the file cannot be opened or mapped
+    LoadResult load(const std::string& path) const;
+
+private:
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        size_t first_row;  // global 1-based data row of the first line
+        std::vector<LoadedRequest> requests;
+        size_t bad_rows{0};
+    };
+
+    void parseChunk(Chunk& chunk) const;
+    bool parseLine(const char* begin, const char* end, size_t row, std::vector<LoadedRequest>& out) const;
+
+    Options options_;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef DROP_COPY_H
+#define DROP_COPY_H
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "event_api.h"
+
+enum class SlowConsumerPolicy {
+    CONFLATE,    // fills that find the ring full are folded into one report per order
+    DISCONNECT   // the stream stops receiving until the client reconnects and reconciles
+};
+
+struct DropCopyConfig {
+    size_t ring_capacity = 4096;           // reports per client, rounded up to a power of two
+    SlowConsumerPolicy policy = SlowConsumerPolicy::CONFLATE;
+    size_t max_conflated_orders = 65536;   // a conflating stream past this disconnects
+    size_t max_clients = 1024;
+};
+
+// One side of one fill, as seen by the owner of the order
+struct ExecutionReport {
+    SymbolId symbol_id;
+    OrdId    order_id;
+    Side     side;
+    bool     maker;       // the order was resting
+    uint32_t fills;       // more than one when conflated; price is then their VWAP
+    Px       price;
+    Qty      qty;
+    uint64_t match_seq;   // of the last fill
+    int64_t  ts_ns;       // wall clock of the last fill (Clock ticks until polled)
+};
+
+// A client's execution reports. Any strand produces into a bounded ring
+// (same slot-sequence scheme as shm::MessageRing); one consumer thread polls
+// it. A full ring is handled by the policy and never waits on the consumer.
+class ExecutionStream {
+public:
+    ExecutionStream(ClientId client, const DropCopyConfig& config);
+
+    const ClientId& client() const { return client_; }
+
+    // Hands up to max reports to f(const ExecutionReport&): the ring first,
+    // then any conflated ones once it has drained. Returns how many.
+    template<class F>
+    size_t poll(F&& f, size_t max = std::numeric_limits<size_t>::max());
+
+    bool connected() const { return state_.load(std::memory_order_acquire) == ACTIVE; }
+    // After a disconnect: drops whatever is still queued and receives again.
+    // Reports from fills in progress at that moment may still arrive.
+    void reconnect();
+
+    uint64_t conflated() const { return conflated_.load(std::memory_order_relaxed); }  // fills folded into another report
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }      // lost while disconnected
+
+private:
+    friend class DropCopy;
+
+    enum State : uint32_t { ACTIVE, DISCONNECTED, CLOSED };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq;
+        ExecutionReport report;
+    };
+
+    void push(const ExecutionReport& report);
+    bool tryPush(const ExecutionReport& report);
+    bool tryPop(ExecutionReport& out);
+    void conflate(const ExecutionReport& report);
+    size_t drainConflated(std::vector<ExecutionReport>& out);
+
+    ClientId client_;
+    SlowConsumerPolicy policy_;
+    size_t maxConflated_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<uint64_t> head_{0};  // next position to claim
+    alignas(64) std::atomic<uint64_t> tail_{0};  // next position to consume
+    std::atomic<uint32_t> state_{ACTIVE};
+    std::atomic<uint64_t> conflated_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    // Slow path only. Once something is conflated, later reports queue here
+    // too until the consumer takes them, so an order's reports stay in order.
+    std::atomic<bool> conflating_{false};
+    std::mutex overflowMutex_;
+    std::vector<ExecutionReport> overflow_;
+    std::unordered_map<OrdId, size_t> overflowIndex_;  // order -> its report in overflow_
+    std::vector<ExecutionReport> delivering_;          // consumer side
+    size_t delivered_{0};
+};
+
+// Routes both sides of every fill to the owners' streams. Streams are created
+// on subscribe and live as long as the DropCopy, so the strands look them up
+// in a fixed open-addressed table without locks or reclamation.
+class DropCopy {
+public:
+    explicit DropCopy(DropCopyConfig config = {});
+
+    // The client's stream, reconnected if it already exists; nullptr once
+    // max_clients have subscribed. Call from the thread that polls it.
+    ExecutionStream* subscribe(const ClientId& client);
+    // The stream stops receiving; the pointer stays valid
+    void unsubscribe(const ClientId& client);
+
+    // Producer side: called on the symbol's strand for every trade
+    void onTrade(SymbolId symbol, const TradeLog& trade);
+    bool empty() const { return subscribed_.load(std::memory_order_relaxed) == 0; }
+
+private:
+    ExecutionStream* find(const ClientId& client) const;
+
+    DropCopyConfig config_;
+    std::unique_ptr<std::atomic<ExecutionStream*>[]> table_;
+    size_t mask_;
+    std::atomic<size_t> subscribed_{0};
+    std::mutex mutex_;  // subscribe/unsubscribe
+    std::vector<std::unique_ptr<ExecutionStream>> streams_;
+};
+
+template<class F>
+size_t ExecutionStream::poll(F&& f, size_t max) {
+    size_t n = 0;
+    ExecutionReport report;
+    while (n < max) {
+        // Conflated reports taken earlier are older than anything in the ring
+        if (delivered_ < delivering_.size()) {
+            f(delivering_[delivered_++]);
+        } else if (tryPop(report)) {
+            f(report);
+        } else if (drainConflated(delivering_) == 0) {
+            break;
+        } else {
+            continue;
+        }
+        ++n;
+    }
+    return n;
+}
+
+#endif
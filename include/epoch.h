@@ -0,0 +1,55 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Read-mostly protection in the style of sleepable RCU. Readers bracket their
+// use of a shared pointer with a Reader guard: two atomic increments on a
+// cache line their thread mostly has to itself, no locks and no waiting.
+// A writer publishes a new version, calls synchronize(), and may then free
+// whatever the old version referenced; synchronize() waits only for readers
+// that were already inside when it was called.
+class EpochDomain {
+public:
+    class Reader {
+    public:
+        explicit Reader(EpochDomain& domain)
+            : counter_(domain.stripes_[stripe()].active[domain.epoch_.load(std::memory_order_seq_cst) & 1]) {
+            counter_.fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~Reader() { counter_.fetch_sub(1, std::memory_order_release); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+    private:
+        std::atomic<int64_t>& counter_;
+    };
+
+    void synchronize();
+
+private:
+    static constexpr size_t kStripes = 64;
+
+    struct alignas(64) Stripe {
+        std::atomic<int64_t> active[2]{};
+    };
+
+    static size_t stripe() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+        return index;
+    }
+
+    void flipAndDrain();
+
+    std::array<Stripe, kStripes> stripes_{};
+    std::atomic<uint64_t> epoch_{0};
+    std::mutex writer_;
+};
+
+#endif
@@ -5,7 +5,9 @@
 #include "request_api.h"
 #include <ostream>
 #include <iomanip>
+#include <ctime>
 #include <functional>
+#include <vector>
 
 struct Fill {
   Symb symbol;
@@ -21,7 +23,11 @@ struct Fill {
 enum class RequestStatus { OK, REJECTED, NOOP };
 enum class RejectReason {
   NONE, UNKNOWN_SYMBOL, UNKNOWN_ORDER, INVALID_PRICE, INVALID_QUANTITY,
-  NOT_MODIFIABLE, BOOK_CLOSED
+  NOT_MODIFIABLE, BOOK_CLOSED, RISK_LIMIT_BREACHED, INVALID_EXPIRY,
+  THROTTLED,  // refused at admission: rate limit, full queue or too many in flight
+  STANDBY,    // sent to a backup that has not been promoted
+  DUPLICATE_ORDER_ID,  // an order with this id is still live on the book
+  INTERNAL_ERROR       // the engine threw while processing the request
 };
 
 struct RequestOutcome {
@@ -29,7 +35,7 @@ struct RequestOutcome {
   RequestStatus        status{RequestStatus::OK};
   RejectReason         reason{RejectReason::NONE}; // valid when REJECTED/NOOP
   std::string          message;                    // human-friendly summary (optional)
-  std::vector<Fill>    fills;                      // taker-view fills produced by *this* request only
+  std::vector<Fill>    fills{};                    // taker-view fills produced by *this* request only
   // Optional convenience:
   Qty             taker_filled_qty{};         // sum of fills
   Qty             taker_remaining_qty{};      // after processing (for NEW/MODIFY)
@@ -46,7 +52,8 @@ struct RequestLog {
 
 enum class OrderEventType {
   NEW_ACCEPTED, REPLACED, CANCELED, EXPIRED, REJECTED,
-  PARTIALLY_FILLED, FILLED
+  PARTIALLY_FILLED, FILLED,
+  TRIGGERED  // a parked stop fired and re-entered matching as its triggered type
 };
 
 struct OrderLog {
@@ -68,10 +75,38 @@ struct TradeLog {
   Timestamp   ts{};
 
   Fill        fill;            // embed your Fill directly
+  // Owners of the two orders, for execution report routing; not journaled
+  ClientId    taker_client;
+  ClientId    maker_client;
+};
+
+// aggregated depth; quantities are what the book shows, so iceberg
+// reserves are never included
+struct PriceLevel {
+  Px     price{};
+  Qty    quantity{};
+  size_t order_count{};
+};
+
+struct L2Snapshot {
+  std::string symbol;
+  std::vector<PriceLevel> bids;  // best first
+  std::vector<PriceLevel> asks;  // best first
+  uint64_t    checksum{};        // of the whole book, see OrderBook::checksum_
+};
+
+// Journaled with the order events every JournalConfig::checksum_interval
+// requests: the book checksum after order event seq
+struct ChecksumLog {
+  std::string symbol;
+  uint64_t    seq{};
+  Timestamp   ts{};
+  uint64_t    checksum{};
 };
 
 using OrderLogger = std::function<void(const OrderLog&)>;
 using TradeLogger = std::function<void(const TradeLog&)>;
+using OrderBatchLogger = std::function<void(std::vector<OrderLog>&&)>;
 
 inline std::ostream& operator<<(std::ostream& os, const Fill& fill) {
     return os << fill.symbol << "," << fill.taker_id << "," << fill.maker_id << "," 
@@ -89,6 +124,7 @@ inline std::ostream& operator<<(std::ostream& os, OrderEventType type) {
         case OrderEventType::REJECTED: return os << "REJECTED";
         case OrderEventType::PARTIALLY_FILLED: return os << "PARTIALLY_FILLED";
         case OrderEventType::FILLED: return os << "FILLED";
+        case OrderEventType::TRIGGERED: return os << "TRIGGERED";
         default: return os << "UNKNOWN";
     }
 }
@@ -115,14 +151,28 @@ inline std::ostream& operator<<(std::ostream& os, RejectReason reason) {
         case RejectReason::INVALID_QUANTITY: return os << "INVALID_QUANTITY";
         case RejectReason::NOT_MODIFIABLE: return os << "NOT_MODIFIABLE";
         case RejectReason::BOOK_CLOSED: return os << "BOOK_CLOSED";
+        case RejectReason::RISK_LIMIT_BREACHED: return os << "RISK_LIMIT_BREACHED";
+        case RejectReason::INVALID_EXPIRY: return os << "INVALID_EXPIRY";
+        case RejectReason::THROTTLED: return os << "THROTTLED";
+        case RejectReason::STANDBY: return os << "STANDBY";
+        case RejectReason::DUPLICATE_ORDER_ID: return os << "DUPLICATE_ORDER_ID";
+        case RejectReason::INTERNAL_ERROR: return os << "INTERNAL_ERROR";
         default: return os << "UNKNOWN";
     }
 }
 
+// Counter ticks become wall-clock time only here, when a log line is written
+inline std::ostream& put_wall_time(std::ostream& os, Timestamp ts) {
+    int64_t wall_ns = Clock::toWallNanos(ts);
+    std::time_t secs = wall_ns / 1000000000LL;
+    std::tm local{};
+    localtime_r(&secs, &local);
+    return os << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << "."
+              << std::setw(9) << std::setfill('0') << wall_ns % 1000000000LL << std::setfill(' ');
+}
+
 inline std::ostream& operator<<(std::ostream& os, const OrderLog& orderLog) {
-    auto time_t = orderLog.ts.time_since_epoch().count() / 1000000000LL;
-    
-    return os << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << ","
+    return put_wall_time(os, orderLog.ts) << ","
               << orderLog.symbol << "," << orderLog.seq << "," << orderLog.type << ","
               << orderLog.order_id << "," << orderLog.side << ","
               << std::fixed << std::setprecision(2) << orderLog.price << ","
@@ -130,11 +180,27 @@ inline std::ostream& operator<<(std::ostream& os, const OrderLog& orderLog) {
 }
 
 inline std::ostream& operator<<(std::ostream& os, const TradeLog& tradeLog) {
-    auto time_t = tradeLog.ts.time_since_epoch().count() / 1000000000LL;
-    return os << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << ","
+    return put_wall_time(os, tradeLog.ts) << ","
               << tradeLog.symbol << "," << tradeLog.seq << "," << tradeLog.fill;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const ChecksumLog& checksumLog) {
+    return put_wall_time(os, checksumLog.ts) << ","
+              << checksumLog.symbol << "," << checksumLog.seq << ",CHECKSUM,"
+              << std::hex << checksumLog.checksum << std::dec;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const L2Snapshot& snapshot) {
+    os << snapshot.symbol;
+    for (const auto& level : snapshot.bids) {
+        os << ",B:" << std::fixed << std::setprecision(2) << level.price << "x" << level.quantity;
+    }
+    for (const auto& level : snapshot.asks) {
+        os << ",A:" << std::fixed << std::setprecision(2) << level.price << "x" << level.quantity;
+    }
+    return os << ",C:" << std::hex << snapshot.checksum << std::dec;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const RequestOutcome& outcome) {
     os << outcome.request_id << "," << outcome.status << "," << outcome.reason << ","
        << "\"" << outcome.message << "\"," << outcome.taker_filled_qty << ","
@@ -5,43 +5,247 @@
 #include "request_api.h"
 #include "event_api.h"
 #include "thread_pool.h"
+#include "shard.h"
+#include "epoch.h"
 #include "strand.h"
 #include "logger.h"
 #include "matching_engine.h"
+#include "risk_manager.h"
+#include "admission.h"
+#include "trade_stats.h"
+#include "drop_copy.h"
+#include "replication.h"
+#include "tracing.h"
 #include <vector>
 #include <future>
 #include <functional>
 #include <unordered_map>
 #include <memory>
 #include <optional>
+#include <deque>
+#include <condition_variable>
 
 
 class Exchange {
 public:
-    explicit Exchange(const std::vector<Symb>& symbols, size_t num_worker_threads = std::thread::hardware_concurrency());
+    using Completion = std::function<void(RequestOutcome&&)>;
+
+    // Market data taps. Both run on the symbol's strand; install before
+    // traffic starts.
+    struct MarketDataSink {
+        std::function<void(SymbolId, const Fill&)> onTrade;
+        // Top depth levels per side after every request
+        std::function<void(SymbolId, const L2Snapshot&)> onBook;
+        size_t depth{1};
+    };
+
+    // Load and placement as of the last rebalance pass. Rates are requests/s
+    // over the pass interval; queue depths are read live.
+    struct SymbolStats {
+        Symb symbol;
+        SymbolId id;
+        size_t shard;
+        uint64_t requests;
+        double request_rate;
+        size_t queue_depth;
+    };
+    struct ShardStats {
+        size_t index;
+        int cpu;    // -1 when not pinned
+        int node;
+        size_t symbols;
+        double request_rate;
+        size_t queue_depth;
+        bool huge_pages;
+        size_t arena_used;
+        size_t arena_capacity;
+        // process_request counter totals by request type (kRequestTypeNames);
+        // only with ShardConfig::perf_counters
+        bool perf_counters;
+        std::array<PerfTotals, kRequestTypes> perf;
+    };
+    struct RebalanceDecision {
+        int64_t wall_ns;
+        Symb symbol;
+        size_t from_shard;
+        size_t to_shard;
+        double symbol_rate;
+        double from_rate;   // shard rates before the move
+        double to_rate;
+    };
+    struct Stats {
+        std::vector<ShardStats> shards{};
+        std::vector<SymbolStats> symbols{};
+        std::vector<RebalanceDecision> rebalances{};  // most recent, oldest first
+        uint64_t rebalance_count{0};
+    };
+
+    // One shard (matching thread plus arena) per worker thread; symbols are
+    // spread over them by id
+    explicit Exchange(const std::vector<Symb>& symbols, size_t num_worker_threads = std::thread::hardware_concurrency(),
+                      JournalConfig journal = {}, ShardConfig shards = {}, AdmissionConfig admission = {},
+                      StatsConfig stats = {}, DropCopyConfig dropCopy = {}, TraceConfig trace = {},
+                      RiskConfig risk = {});
     ~Exchange();
 
+    // Completes once the request is matched; under SYNC_BEFORE_ACK, only
+    // once its journal entries are also on disk
+    std::future<RequestOutcome> submitRequest(TradingRequest&& tr);
+    // Same, but done runs on the strand (or the journal thread) instead of
+    // completing a future; it must not block
+    void submitRequest(TradingRequest&& tr, Completion done);
+    // Routes by id without hashing the symbol; the request's symbol is
+    // filled in from the listing
+    void submitRequest(SymbolId symbol, TradingRequest&& tr, Completion done);
     RequestOutcome processRequest(TradingRequest&& tr);
+    std::optional<SymbolId> symbolId(std::string_view symbol);
+    // Lists a symbol with an empty book and returns its id, or the existing
+    // id if it is already listed. Ids are never reused.
+    SymbolId addSymbol(const Symb& symbol, const AllocationRules& allocation = {});
+    // Delists a symbol: new requests for it are rejected as unknown, the ones
+    // already queued are processed, then every resting order and stop is
+    // cancelled and returns once that is committed to the journal. False if
+    // it is not listed. Call before shutdown.
+    bool removeSymbol(const Symb& symbol);
+    void setMarketDataSink(MarketDataSink sink);
+    Stats stats();
+    // One sampling and rebalancing pass, as run every rebalance_interval;
+    // returns the move it made, if any
+    std::optional<RebalanceDecision> rebalance();
+    // Kill switch: mass cancel one client's orders in every symbol
+    std::vector<RequestOutcome> cancelAllForClient(const ClientId& client);
+    // Same without waiting; done runs once per listed symbol
+    void cancelAllForClient(const ClientId& client, const Completion& done);
+    std::optional<L2Snapshot> getL2Snapshot(const Symb& symbol, size_t depth = 10);
+    // Switches a listed symbol's level allocation between requests; false if
+    // it is not listed
+    bool setAllocationRules(const Symb& symbol, const AllocationRules& allocation);
+    // Trade statistics, read without going through the strand
+    std::optional<TradeSummary> tradeSummary(std::string_view symbol);
+    std::vector<OhlcvBar> bars(std::string_view symbol, std::chrono::milliseconds interval, size_t count);
+    // Maker and taker execution reports for one client's orders; see DropCopy
+    ExecutionStream* subscribeExecutions(const ClientId& client);
+    void unsubscribeExecutions(const ClientId& client);
+    // Committed trades on disk, by symbol and time range (JournalConfig::trade_store)
+    TradeHistory tradeHistory() const;
+    // Primary: streams every book's sequenced input to a backup from here
+    // on. Call before the first request; the backup starts from empty books.
+    void replicateTo(std::unique_ptr<ReplicationTransport> transport, ReplicationConfig config = {});
+    // Backup: client requests are rejected as STANDBY and the primary's
+    // stream is applied instead. Call before the first request.
+    void followPrimary(std::unique_ptr<ReplicationTransport> transport);
+    // Failover: stops following, waits for the frames already received to
+    // be applied and starts taking requests. False if the stream broke or a
+    // book ever disagreed with the primary's checksum.
+    bool promote();
+    // Sampled request spans still held by the tracer (TraceConfig), as
+    // Chrome trace_event JSON; dumpTrace writes them to a new file under
+    // TraceConfig::dump_directory and returns its path
+    void writeTrace(std::ostream& out) const;
+    std::string dumpTrace();
+    // Overrides RiskConfig::defaults for one client; false when the risk
+    // table has no room for it
+    bool setRiskLimits(const ClientId& client, const RiskLimits& limits);
+    // Sessions call these at logon and logoff. Attaching holds the client's
+    // per-client state until it detaches; false when the exchange already
+    // tracks as many clients as it can, and the logon should be refused.
+    bool attachClient(const ClientId& client);
+    void detachClient(const ClientId& client);
+    // Overrides AdmissionConfig::client_rate for one client; false when the
+    // admission table has no room for it
+    bool setClientRate(const ClientId& client, const ClientRate& rate);
+    // DAY orders entered after this takes effect expire at close
+    void setSessionClose(Timestamp close);
     void shutdown();
 
 private:
 
     struct AssetContext{
-        explicit AssetContext(const std::string& symbol, ThreadPool& threadPool);
+        AssetContext(const std::string& symbol, SymbolId id, Shard& shard, const StatsConfig& stats);
         std::unique_ptr<Strand> strand_;
         std::unique_ptr<OrderBook> orderBook_;
         std::string symbol_;
+        SymbolId id_;
+        Shard* shard_;
+        std::atomic<uint64_t> requests_{0};
+        // Sampled by rebalance() under listingMutex_
+        uint64_t sampledRequests_{0};
+        double rate_{0};
+        TradeStatistics tradeStats_;
+        uint64_t sinceChecksum_{0};  // strand only
+        std::vector<char> replicationBody_;  // strand only
+    };
+
+    struct SymbolHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view symbol) const { return std::hash<std::string_view>{}(symbol); }
     };
-    using AssetRef = std::reference_wrapper<AssetContext>;
 
-    std::optional<AssetRef> getAssetContext(std::string_view symbol);
+    // Immutable once published. Request routing reads it inside an
+    // EpochDomain::Reader; listing changes copy it, publish the copy and
+    // synchronize before the old one (or a removed context) is freed.
+    struct Listing {
+        std::unordered_map<std::string, AssetContext*, SymbolHash, std::equal_to<>> bySymbol;
+        std::vector<AssetContext*> byId;  // nullptr once delisted
+    };
 
-    void onRequestProcessed(const RequestOutcome& outcome);
+    // Callers hold an EpochDomain::Reader on epoch_ for as long as they use
+    // the result
+    AssetContext* findAsset(std::string_view symbol) const;
+    AssetContext* findAsset(SymbolId id) const;
+    void publish(std::unique_ptr<const Listing> next);
+    void dispatch(AssetContext& ac, TradingRequest&& tr, Completion done);
+    // Runs one request through the engine and the per-request taps; strand only
+    RequestOutcome apply(AssetContext& ac, TradingRequest&& tr, Timestamp ingress);
+    // The per-fill taps, for the asset apply() is matching on this thread
+    void onTrade(AssetContext& ac, const TradeLog& trade);
+    static thread_local AssetContext* matching_;
+    // Queues a frame with ac.replicationBody_ and the book's current state;
+    // returns its stream sequence, 0 when not replicating
+    uint64_t replicate(AssetContext& ac, replication::FrameType type, Timestamp ingress);
+    void applyReplicated(replication::Frame&& frame);
+    // Under an epoch reader: whether a BLOCK submitter should leave the
+    // epoch section and wait for room on ac's queue before dispatching
+    bool mustWait(const AssetContext& ac, const TradingRequest& req,
+                  std::optional<std::chrono::steady_clock::time_point>& blockedUntil);
+    static bool isCancel(const TradingRequest& req);
+    size_t queueLimit(bool cancel) const;
+    // nullptr when admitted, else why not
+    const char* admit(AssetContext& ac, const ClientId* client, bool cancel, Timestamp ingress);
 
-    ThreadPool threadPool_;
+    uint64_t onRequestProcessed(const RequestOutcome& outcome);
+    void migrate(AssetContext& ac, Shard& to);
+    void rebalanceLoop();
+
+    std::vector<std::unique_ptr<Shard>> shards_;
     std::unique_ptr<Logger> logger_;
+    RiskManager riskManager_;
+    AdmissionControl admission_;
+    DropCopy dropCopy_;
+    Tracer tracer_;
     MatchingEngine matchingEngine_;
-    std::unordered_map<std::string, std::unique_ptr<AssetContext>> assets_;
+    EpochDomain epoch_;
+    std::atomic<const Listing*> listing_{nullptr};
+    std::mutex listingMutex_;  // serialises listing changes; guards everything below
+    std::unique_ptr<const Listing> currentListing_;
+    std::vector<std::unique_ptr<AssetContext>> assets_;  // by id
+    Timestamp sessionClose_{Timestamp::max()};
+    ShardConfig shardConfig_;
+    StatsConfig statsConfig_;
+    std::chrono::steady_clock::time_point lastSample_;
+    std::deque<RebalanceDecision> rebalances_;
+    uint64_t rebalanceCount_{0};
+
+    std::mutex rebalanceMutex_;
+    std::condition_variable rebalanceWake_;
+    bool stopRebalancing_{false};
+    std::thread rebalanceThread_;
+    MarketDataSink marketData_;
+
+    std::unique_ptr<Replicator> replicator_;
+    std::unique_ptr<ReplicaReceiver> replica_;
+    std::atomic<bool> standby_{false};
+    std::atomic<uint64_t> divergences_{0};
 };
 
 
@@ -0,0 +1,116 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "exchange.h"
+#include "wire_protocol.h"
+
+// TCP order entry speaking wire_protocol.h. A few I/O threads each run an
+// epoll loop over their share of the sessions; the first one also owns the
+// listening socket and deals new connections out round-robin. Requests are
+// decoded in place from the receive buffer and routed by symbol id.
+// Execution reports are encoded by the completion on the matching strand
+// into the session's send buffer, and the owning I/O thread is woken
+// through an eventfd to flush them. A session may only cancel or modify its
+// own client's orders; when it closes they are mass cancelled, and one that
+// stops reading is dropped once its unsent reports pass max_tx_bytes. A
+// logon the exchange cannot track (Exchange::attachClient) is disconnected,
+// as is a second logon for a client that already has a live session.
+class Gateway {
+public:
+    struct Config {
+        size_t io_threads{1};
+        // Mass cancel a logged-on client's orders when its session closes
+        bool cancel_on_disconnect{true};
+        // A session whose unsent reports grow past this is dropped
+        size_t max_tx_bytes{4 * 1024 * 1024};
+    };
+
+    // port 0 picks an ephemeral port; see port()
+    Gateway(Exchange& exchange, uint16_t port, Config config);
+    explicit Gateway(Exchange& exchange, uint16_t port = 0, size_t ioThreads = 1)
+        : Gateway(exchange, port, Config{.io_threads = ioThreads}) {}
+    ~Gateway();
+
+    uint16_t port() const { return port_; }
+    void shutdown();
+
+private:
+    static constexpr size_t kMaxMessage = 64 * 1024;
+    static constexpr size_t kRecvChunk = 64 * 1024;
+
+    struct IoThread;
+
+    struct Session {
+        int fd{-1};
+        std::weak_ptr<IoThread> owner;
+        ClientId client;
+        bool loggedOn{false};
+
+        // I/O thread only
+        std::vector<char> rx;
+        size_t rxLen{0};
+        std::vector<char> sending;
+        size_t sendOffset{0};
+        bool wantWrite{false};
+
+        // Appended to by completions on the matching strands
+        std::mutex txMutex;
+        std::vector<char> tx;
+        size_t maxTx{0};
+        bool closed{false};
+        bool overflowed{false};  // closed for falling too far behind
+    };
+    using SessionPtr = std::shared_ptr<Session>;
+
+    // Completions reach it through Session::owner, so a report produced
+    // after shutdown finds it gone instead of dangling
+    struct IoThread {
+        ~IoThread();
+
+        int epollFd{-1};
+        int wakeFd{-1};
+        std::unordered_map<int, SessionPtr> sessions;
+
+        std::mutex pendingMutex;
+        std::vector<SessionPtr> pendingAccepts;
+        std::vector<SessionPtr> pendingWrites;
+
+        std::thread thread;
+
+        void wake();
+    };
+    using IoThreadPtr = std::shared_ptr<IoThread>;
+
+    void ioLoop(IoThread& io);
+    void acceptConnections();
+    void adopt(IoThread& io, const SessionPtr& session);
+    void onReadable(IoThread& io, const SessionPtr& session);
+    bool onMessage(const SessionPtr& session, const char* data, size_t length);
+    void flush(IoThread& io, Session& session);
+    void closeSession(IoThread& io, const SessionPtr& session);
+
+    static Exchange::Completion reportTo(const SessionPtr& session);
+    static void queueReply(const SessionPtr& session, const char* data, size_t length);
+
+    Exchange& exchange_;
+    Config config_;
+    int listenFd_{-1};
+    uint16_t port_{0};
+    std::vector<IoThreadPtr> ioThreads_;
+    size_t nextIo_{0};
+    std::atomic<bool> stop_{false};
+
+    // Clients with a logged-on session, across all I/O threads
+    std::mutex clientsMutex_;
+    std::unordered_set<ClientId> loggedOnClients_;
+};
+
+#endif
@@ -1,55 +1,152 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <fstream>
-#include <queue>
-#include <thread>
-#include <mutex>
+#include <chrono>
 #include <condition_variable>
-#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <variant>
+#include <vector>
 #include <filesystem>
+#include <sys/types.h>
 #include "event_api.h"
+#include "trade_store.h"
+
+enum class Durability {
+    NONE,             // written, never synced; acks don't wait
+    GROUP_COMMIT,     // synced every group_interval or group_events; acks don't wait
+    SYNC_BEFORE_ACK   // synced as soon as possible; acks wait for the sync
+};
+
+struct JournalConfig {
+    // Where the exchange keeps its journal; one per instance, e.g. a backup
+    // on the same host needs its own
+    std::string directory = "logs_internal/";
+    Durability durability = Durability::GROUP_COMMIT;
+    std::chrono::microseconds group_interval{500};
+    size_t group_events = 4096;
+    // Producers block once this many events are waiting for the writer
+    size_t max_queued_events = size_t{1} << 20;
+    // Also write every trade to the columnar store under <dir>/trades
+    bool trade_store = true;
+    // Requests per symbol between book checksums in orders.log; 0 = never
+    size_t checksum_interval = 1024;
+};
 
+// Journal writer. Producers append events to a queue under one short lock and
+// get a journal sequence number. A single writer thread drains the queue in
+// batches and formats each file into a chain of page-aligned chunks. It writes
+// every chain with one pwritev and then, depending on the durability mode,
+// calls fdatasync. After that it advances the commit watermark and runs the
+// callbacks waiting on it. A failed write or sync keeps the batch and retries
+// it with backoff, so the watermark never passes an event that is not on
+// disk; if the logger shuts down first, the waiting callbacks are dropped.
 class Logger {
 public:
-    explicit Logger(const std::string& logDirectory);
+    using CommitCallback = std::function<void()>;
+
+    explicit Logger(const std::string& logDirectory, JournalConfig config = {});
     ~Logger();
-    
+
     void logOrderEvent(const OrderLog& orderLog);
+    void logOrderEvents(std::vector<OrderLog>&& orderLogs);
     void logTradeEvent(const TradeLog& tradeLog);
-    void logRequestOutcome(const RequestOutcome& outcome);
+    void logChecksum(const ChecksumLog& checksumLog);
+    // Returns the outcome's journal sequence; every event logged before it
+    // on the same thread has a lower one
+    uint64_t logRequestOutcome(const RequestOutcome& outcome);
+
+    // Runs callback on the writer thread once seq is committed, or right
+    // away if it already is
+    void whenCommitted(uint64_t seq, CommitCallback callback);
+    // false if the logger gave up before seq was committed
+    bool waitForCommit(uint64_t seq);
+    uint64_t committedSequence() const { return committed_.load(std::memory_order_acquire); }
+    Durability durability() const { return config_.durability; }
+    size_t checksumInterval() const { return config_.checksum_interval; }
+    const std::string& directory() const { return logDirectory_; }
+
     void shutdown();
-    
+
 private:
-    struct LogEntry {
-        enum Type { ORDER_EVENT, TRADE_EVENT, REQUEST_OUTCOME };
-        Type type;
-        OrderLog orderLog;
-        TradeLog tradeLog;
-        RequestOutcome requestOutcome;
-        
-        LogEntry(const OrderLog& ol) : type(ORDER_EVENT), orderLog(ol) {}
-        LogEntry(const TradeLog& tl) : type(TRADE_EVENT), tradeLog(tl) {}
-        LogEntry(const RequestOutcome& ro) : type(REQUEST_OUTCOME), requestOutcome(ro) {}
+    using LogEntry = std::variant<OrderLog, TradeLog, RequestOutcome, ChecksumLog>;
+
+    static constexpr size_t kChunkBytes = 64 * 1024;
+    static constexpr size_t kChunkAlign = 4096;
+
+    // Formats straight into a chain of aligned chunks that pwritev can hand
+    // to the kernel as one iovec array
+    class ChunkBuffer : public std::streambuf {
+    public:
+        ~ChunkBuffer() override;
+        bool empty() const { return chunks_.empty(); }
+        // Writes whatever has not been written yet at offset, advancing it;
+        // false on I/O error, keeping the rest for the next call
+        bool writeTo(int fd, off_t& offset);
+        // Marks everything unwritten again; returns how much had been
+        size_t rewind();
+        // Recycles the chunks once they are on disk
+        void release();
+
+    protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+    private:
+        void nextChunk();
+
+        std::vector<char*> chunks_;
+        std::vector<char*> spare_;
+        size_t sent_{0};  // bytes of chunks_ already written
     };
-    
+
+    struct JournalFile {
+        int fd{-1};
+        off_t offset{0};
+        ChunkBuffer buffer;
+        std::ostream out{&buffer};
+        bool dirty() const { return !buffer.empty(); }
+    };
+
     std::string logDirectory_;
-    std::ofstream orderLogFile_;
-    std::ofstream tradeLogFile_;
-    std::ofstream requestLogFile_;
-    
-    std::queue<LogEntry> logQueue_;
+    JournalConfig config_;
+    JournalFile orderLogFile_;
+    JournalFile tradeLogFile_;
+    JournalFile requestLogFile_;
+    std::unique_ptr<TradeStoreWriter> tradeStore_;  // writer thread only
+
+    std::vector<LogEntry> logQueue_;
+    uint64_t enqueued_{0};  // last sequence handed out, under queueMutex_
     std::mutex queueMutex_;
     std::condition_variable queueCondition_;
+    std::condition_variable spaceCondition_;  // producers waiting on max_queued_events
     std::atomic<bool> shutdown_;
+
+    std::atomic<uint64_t> committed_{0};
+    std::multimap<uint64_t, CommitCallback> pendingCommits_;  // by sequence
+    bool failed_{false};  // shut down with a batch it could not commit
+    std::mutex commitMutex_;
+    std::condition_variable commitCondition_;
+
     std::thread loggerThread_;
-    
+
     void loggerLoop();
-    void writeOrderEvent(const OrderLog& orderLog);
-    void writeTradeEvent(const TradeLog& tradeLog);
-    void writeRequestOutcome(const RequestOutcome& outcome);
+    void waitForSpace(std::unique_lock<std::mutex>& lock);
+    void writeEntry(const LogEntry& entry);
+    bool writeJournal(JournalFile& file);
+    void commit(uint64_t upto);
+    void failJournal();
+    void openJournal(JournalFile& file, const std::string& name);
+    void closeJournal(JournalFile& file);
     void createLogDirectory();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -10,6 +10,7 @@
 #include "request_api.h"
 #include "event_api.h"
 #include "orderbook.h"
+#include "risk_manager.h"
 
 template<class... Ts> struct Overloaded : Ts... { using Ts::operator()...; };
 template<class... Ts> Overloaded(Ts...) -> Overloaded<Ts...>;
@@ -17,42 +18,106 @@ template<class... Ts> Overloaded(Ts...) -> Overloaded<Ts...>;
 class MatchingEngine {
 public:
     
-    // Constructor to set logging functions
-    MatchingEngine(OrderLogger order_logger, TradeLogger trade_logger)
-        : order_logger_(order_logger), trade_logger_(trade_logger) {}
+    // Constructor to set logging functions and the optional pre-trade risk stage
+    MatchingEngine(OrderLogger order_logger, TradeLogger trade_logger, RiskManager* risk_manager = nullptr,
+                   OrderBatchLogger order_batch_logger = nullptr)
+        : order_logger_(order_logger), trade_logger_(trade_logger), risk_manager_(risk_manager),
+          order_batch_logger_(order_batch_logger) {}
     
-    RequestOutcome process_request(OrderBook& book, TradingRequest&& request);
+    // Every event the request produces carries the ingress stamp
+    RequestOutcome process_request(OrderBook& book, TradingRequest&& request, Timestamp ingress = Clock::now());
+
+    // Expire DAY/GTD orders that are due; the owning strand calls this
+    // between requests
+    void expire_orders(OrderBook& book, Timestamp now);
+
+    // Aggregated top-of-book levels as displayed (iceberg reserves hidden)
+    L2Snapshot snapshot_l2(const OrderBook& book, size_t depth) const;
+
+    // The book checksum, tagged with the last order event it reflects
+    ChecksumLog checksum_log(const OrderBook& book, Timestamp ts) const;
 
 private:
     RequestOutcome submit_order(OrderBook& book, std::unique_ptr<Order> order);
+    // triggered: a stop that fired, whose NEW_ACCEPTED went out when it parked
+    RequestOutcome route_order(OrderBook& book, std::unique_ptr<Order> order, bool triggered = false);
     RequestOutcome cancel_order(OrderBook& book, OrdId order_id);
     RequestOutcome modify_order(OrderBook& book, OrdId order_id, Px new_price, Qty new_quantity);
+    RequestOutcome mass_cancel(OrderBook& book, const std::optional<ClientId>& client, std::optional<Side> side);
 
-    RequestOutcome match_limit_order(std::unique_ptr<Order> order, OrderBook& book);
+    RequestOutcome match_limit_order(std::unique_ptr<Order> order, OrderBook& book, bool triggered = false);
     RequestOutcome match_market_order(std::unique_ptr<Order> order, OrderBook& book);
+
+    // Stop handling: park in the trigger index, fire on the last trade price
+    RequestOutcome park_stop_order(std::unique_ptr<Order> order, OrderBook& book);
+    RequestOutcome cancel_stop_order(OrderBook& book, OrdId order_id);
+    // Whether order_id is live, resting or as a pending stop, and belongs to client
+    bool owned_by(const OrderBook& book, OrdId order_id, const ClientId& client) const;
+    std::unique_ptr<Order> take_pending_stop(OrderBook& book, OrdId order_id);
+    void run_stop_triggers(OrderBook& book);
+    void trigger_stop(Order& order, Timestamp ts);
+    static bool stop_triggered(Side side, Px stop_price, Px last_price);
+
+    // Call auction: accumulate without matching, then uncross in one batch
+    RequestOutcome change_phase(OrderBook& book, TradingPhase phase);
+    RequestOutcome accept_in_auction(OrderBook& book, std::unique_ptr<Order> order);
+    RequestOutcome uncross(OrderBook& book);
     
+    // Dispatches on the book's AllocationRules::policy to match_with<Policy>
     std::pair<std::vector<Fill>, std::unique_ptr<Order>> match_against_book(std::unique_ptr<Order> incoming_order, Book& opposite_book,
-                                         Handles& handles, const Symb& symbol);
+                                         OrderBook& book);
+    template<class Policy>
+    std::pair<std::vector<Fill>, std::unique_ptr<Order>> match_with(std::unique_ptr<Order> incoming_order, Book& opposite_book,
+                                         OrderBook& book);
+    // One fill of qty against *it, with its trade and order events; returns
+    // the next resting order to look at
+    Book::iterator execute_fill(OrderMeta& incoming, Book::iterator it, Qty qty, Book& opposite_book, OrderBook& book,
+                                std::vector<Fill>& fills);
 
-    void insert_sorted(std::unique_ptr<Order> order, OrderBook& book);
-    void remove_from_book(OrdId order_id, OrderBook& book);
-    void update_handles_after_removal(Side side, size_t removed_index, Book& book, Handles& handles);
+    // announce: journal NEW_ACCEPTED for it
+    void insert_sorted(std::unique_ptr<Order> order, OrderBook& book, bool announce = true);
+    std::unique_ptr<Order> remove_from_book(OrdId order_id, OrderBook& book);
+    void update_handles_after_removal(size_t removed_index, Book& book, Handles& handles);
+    void erase_filled_prefix(OrderBook& book, Book& book_side, size_t count);
+    void reindex_handles(Book& book_side, Handles& handles);
+
+    // Per-client intrusive lists threaded through the handle maps
+    void link_client_order(OrderBook& book, const OrderMeta& meta);
+    void unlink_client_order(OrderBook& book, const OrderMeta& meta);
+    void link_client_stop(OrderBook& book, const OrderMeta& meta);
+    void unlink_client_stop(OrderBook& book, const OrderMeta& meta);
+    Book::iterator requeue_at_level_back(Book::iterator it, Book& book_side, Handles& handles);
+
+    // true if the entry was still due and the order is gone
+    bool expire_order(OrderBook& book, OrdId order_id, TimingWheel::Tick deadline);
+    bool remove_expired(OrderBook& book, OrdId order_id);
+    void schedule_expiry(OrderBook& book, const OrderMeta& meta);
+
+    // Book membership / fill hooks feeding the risk counters
+    // and the book checksum; every change to a member's remaining quantity
+    // goes through note_quantity_change
+    void note_order_added(OrderBook& book, const OrderMeta& meta);
+    void note_order_removed(OrderBook& book, const OrderMeta& meta);
+    void note_quantity_change(OrderBook& book, const OrderMeta& meta, Qty before);
+    void note_fill(const OrderMeta& taker, const OrderMeta& maker, Qty qty);
+
+    // risk_manager_->check, or the replayed verdict; see OrderBook::risk_verdict_
+    RiskDecision check_risk(OrderBook& book, const OrderMeta& meta, Px ref_price, Qty qty, bool replacing = false);
 
     bool can_match(const Order& incoming, const Order& resting) const;
     
     static bool bid_comparator(const Order& a, const Order& b);
     static bool ask_comparator(const Order& a, const Order& b);
     
-    // Sequence number management
-    static std::unordered_map<std::string, std::atomic<uint64_t>> order_sequences_;
-    static std::unordered_map<std::string, std::atomic<uint64_t>> trade_sequences_;
-    
-    uint64_t get_next_order_sequence(const std::string& symbol);
-    uint64_t get_next_trade_sequence(const std::string& symbol);
+    // Sequence number management; the counters live in the book
+    uint64_t get_next_order_sequence(OrderBook& book);
+    uint64_t get_next_trade_sequence(OrderBook& book);
     
     // Logging function members
     OrderLogger order_logger_;
     TradeLogger trade_logger_;
+    RiskManager* risk_manager_;
+    OrderBatchLogger order_batch_logger_;
 };
 
 
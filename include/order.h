@@ -1,7 +1,6 @@
 #ifndef ORDER_H
 #define ORDER_H
 
-#include <chrono>
 #include <string>
 #include <string_view>
 #include <variant>
@@ -9,7 +8,12 @@
 #include <array>
 #include <optional>
 #include <concepts>
+#include <type_traits>
 #include <cstdint>
+#include <algorithm>
+#include <bit>
+#include "clock.h"
+#include <memory>
 
 // domain types
 using OrdId   = uint64_t;
@@ -17,10 +21,12 @@ using Px     = double;
 using Qty  = uint32_t;
 using Symb    = std::string;
 using ClientId  = std::string;
-using Timestamp = std::chrono::steady_clock::time_point;
+using SymbolId  = uint32_t;     // dense per-exchange index, in listing order
 
 enum class Side { BUY, SELL };
 enum class OrdState { PENDING, ACTIVE, PARTIALLY_FILLED, FILLED, CANCELLED, REJECTED };
+enum class TradingPhase { CONTINUOUS, CALL_AUCTION, CLOSED };
+enum class TimeInForce { GTC, DAY, GTD };
 
 // common fields
 struct OrderMeta {
@@ -31,12 +37,28 @@ struct OrderMeta {
 	Qty      original_quantity;
 	Qty      remaining_quantity;
 	OrdState state;
-	Timestamp   timestamp;
+	Timestamp   timestamp;    // ingress stamp of the request that placed it
+	Timestamp   expire_at{Timestamp::max()}; // DAY/GTD only
 
 	OrderMeta(OrdId oid, const ClientId& cid, Side s, Px p, Qty qty)
 		: order_id(oid), client_id(cid), side(s), price(p),
 			original_quantity(qty), remaining_quantity(qty),
-			state(OrdState::PENDING), timestamp(std::chrono::steady_clock::now()) {}
+			state(OrdState::PENDING), timestamp{} {}
+
+	bool expires() const { return expire_at != Timestamp::max(); }
+};
+
+// unified construction params
+struct NewOrderParams {
+	OrdId   id{};
+	ClientId  client;
+	Side      side;
+	std::optional<Px> price{}; // ignored by market
+	Qty  qty;
+	std::optional<Px> stop_price{}; // trigger for stop types only
+	std::optional<Qty> display_qty{}; // visible slice for iceberg only
+	TimeInForce tif{TimeInForce::GTC};
+	std::optional<Timestamp> expire_at{}; // required for GTD
 };
 
 // concrete orders
@@ -62,13 +84,72 @@ struct LimitOrder {
 	}
 };
 
-// unified construction params
-struct NewOrderParams {
-	OrdId   id{};
-	ClientId  client;
-	Side      side;
-	std::optional<Px> price; // ignored by market
-	Qty  qty;
+// stop orders rest in the trigger index until the last trade crosses
+// stop_price, then re-enter matching as their triggered type
+struct StopOrder {
+	OrderMeta meta;
+	Px stop_price;
+	inline static constexpr std::string_view kName = "STOP";
+
+	StopOrder(OrdId id, const ClientId& c, Side s, Px stop, Qty q)
+		: meta{id, c, s, 0.0, q}, stop_price(stop) {}
+	static StopOrder create(struct NewOrderParams const& p) {
+		return StopOrder(p.id, p.client, p.side, p.stop_price.value_or(0.0), p.qty);
+	}
+	MarketOrder triggered() const {
+		MarketOrder m(meta.order_id, meta.client_id, meta.side, meta.original_quantity);
+		m.meta = meta;
+		return m;
+	}
+};
+
+struct StopLimitOrder {
+	OrderMeta meta;
+	Px stop_price;
+	inline static constexpr std::string_view kName = "STOP_LIMIT";
+
+	StopLimitOrder(OrdId id, const ClientId& c, Side s, Px stop, Px px, Qty q)
+		: meta{id, c, s, px, q}, stop_price(stop) {}
+	static StopLimitOrder create(struct NewOrderParams const& p) {
+		return StopLimitOrder(p.id, p.client, p.side, p.stop_price.value_or(0.0),
+			p.price.value_or(0.0), p.qty);
+	}
+	LimitOrder triggered() const {
+		LimitOrder l(meta.order_id, meta.client_id, meta.side, meta.price, meta.original_quantity);
+		l.meta = meta;
+		return l;
+	}
+};
+
+// icebergs aggress with their full size but rest showing only display_quantity;
+// the rest waits in hidden_quantity and is sliced off as each slice fills
+struct IcebergOrder {
+	OrderMeta meta;
+	Qty display_quantity;
+	Qty hidden_quantity{};
+	inline static constexpr std::string_view kName = "ICEBERG";
+
+	IcebergOrder(OrdId id, const ClientId& c, Side s, Px px, Qty q, Qty display)
+		: meta{id, c, s, px, q}, display_quantity(display) {}
+	static IcebergOrder create(struct NewOrderParams const& p) {
+		return IcebergOrder(p.id, p.client, p.side, p.price.value_or(0.0), p.qty,
+			p.display_qty.value_or(p.qty));
+	}
+
+	// move everything above the display size into the reserve before resting
+	void hide_reserve() {
+		if (meta.remaining_quantity > display_quantity) {
+			hidden_quantity += meta.remaining_quantity - display_quantity;
+			meta.remaining_quantity = display_quantity;
+		}
+	}
+	// refill an exhausted slice from the reserve, returns the new visible qty
+	Qty replenish() {
+		Qty slice = std::min(display_quantity, hidden_quantity);
+		hidden_quantity -= slice;
+		meta.remaining_quantity = slice;
+		return slice;
+	}
 };
 
 // concept: each type must expose kName and static create(NewOrderParams)->T
@@ -81,7 +162,7 @@ concept OrderTypeRequirement = requires (const NewOrderParams& p) {
 // list types once
 template<OrderTypeRequirement... Ts>
 struct Types {};
-using OrderTypes = Types<MarketOrder, LimitOrder>;
+using OrderTypes = Types<MarketOrder, LimitOrder, StopOrder, StopLimitOrder, IcebergOrder>;
 
 // derive variant/tuple
 template<class> struct to_variant;
@@ -100,32 +181,112 @@ template<OrderTypeRequirement... Ts>
 consteval auto names_array(Types<Ts...>) {
     return std::array<std::string_view, sizeof...(Ts)>{ Ts::kName... };
 }
-inline constexpr auto kOrderNames = names_array(OrderTypes{});  // {"MARKET","LIMIT"}
+inline constexpr auto kOrderNames = names_array(OrderTypes{});  // {"MARKET","LIMIT","STOP","STOP_LIMIT","ICEBERG"}
+
+// an order type's position in OrderTypes; requests and the wire carry this
+// instead of the name
+enum class OrderKind : uint8_t {};
+inline constexpr size_t kOrderKindCount = kOrderNames.size();
+inline constexpr OrderKind kInvalidOrderKind{0xFF};
+
+template<class T, OrderTypeRequirement... Ts>
+consteval OrderKind kind_of(Types<Ts...>) {
+	uint8_t index = 0;
+	((std::is_same_v<T, Ts> ? false : (++index, true)) && ...);
+	return OrderKind{index};
+}
+template<class T>
+inline constexpr OrderKind kOrderKind = kind_of<T>(OrderTypes{});
+
+inline constexpr std::string_view order_kind_name(OrderKind kind) {
+	auto index = static_cast<size_t>(kind);
+	return index < kOrderKindCount ? kOrderNames[index] : std::string_view{"UNKNOWN"};
+}
+
+// Text edges only (CSV, tests): a perfect hash over kOrderNames, found at
+// compile time, so a lookup is one hash, one table load and one compare
+namespace detail {
+	constexpr uint32_t kind_hash(std::string_view name, uint32_t seed) {
+		uint32_t h = 2166136261u ^ seed;  // FNV-1a
+		for (char c : name) {
+			h ^= static_cast<uint8_t>(c);
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	inline constexpr size_t kKindSlots = std::bit_ceil(kOrderKindCount * 2);
+
+	consteval uint32_t find_kind_seed() {
+		for (uint32_t seed = 0; seed < (1u << 16); ++seed) {
+			std::array<bool, kKindSlots> used{};
+			bool collision = false;
+			for (auto name : kOrderNames) {
+				auto slot = kind_hash(name, seed) & (kKindSlots - 1);
+				collision = collision || used[slot];
+				used[slot] = true;
+			}
+			if (!collision) return seed;
+		}
+		throw "no perfect hash for order type names; are they unique?";
+	}
+	inline constexpr uint32_t kKindSeed = find_kind_seed();
+
+	consteval auto kind_slots() {
+		std::array<uint8_t, kKindSlots> slots{};
+		slots.fill(static_cast<uint8_t>(kInvalidOrderKind));
+		for (size_t i = 0; i < kOrderKindCount; ++i) {
+			slots[kind_hash(kOrderNames[i], kKindSeed) & (kKindSlots - 1)] = static_cast<uint8_t>(i);
+		}
+		return slots;
+	}
+	inline constexpr auto kKindTable = kind_slots();
+}
 
-// dispatch by name → call T::create and return Order
-template<class, class F>
-inline bool dispatch_by_name(std::string_view, F&&);
+// unknown names map to kInvalidOrderKind
+inline constexpr OrderKind order_kind_from_name(std::string_view name) {
+	uint8_t index = detail::kKindTable[detail::kind_hash(name, detail::kKindSeed) & (detail::kKindSlots - 1)];
+	if (index >= kOrderKindCount || kOrderNames[index] != name) return kInvalidOrderKind;
+	return OrderKind{index};
+}
 
-template<OrderTypeRequirement... Ts, class F>
-inline bool dispatch_by_name(Types<Ts...>, std::string_view name, F&& f) {
-	bool handled = false;
-	((name == Ts::kName ? (f.template operator()<Ts>(), handled = true) : void()), ...);
-	return handled;
+consteval bool order_names_round_trip() {
+	for (size_t i = 0; i < kOrderKindCount; ++i) {
+		if (order_kind_from_name(kOrderNames[i]) != OrderKind{static_cast<uint8_t>(i)}) return false;
+	}
+	return order_kind_from_name("") == kInvalidOrderKind;
 }
+static_assert(order_names_round_trip());
 
-struct Maker {
+// Converts to T by calling T::create. Passed as the in_place_type argument,
+// the prvalue it returns initialises the variant alternative directly, with
+// no temporary order to move from
+template<class T>
+struct CreateFrom {
 	const NewOrderParams& p;
-	Order out;
-	Maker(const NewOrderParams& params) : p(params), out(MarketOrder(0, "", Side::BUY, 0)) {}
-	template<class T> void operator()() { out = T::create(p); }
+	operator T() const { return T::create(p); }
 };
 
-// factory function for creating an order
+template<class T>
+std::unique_ptr<Order> make_order(const NewOrderParams& p) {
+	return std::make_unique<Order>(std::in_place_type<T>, CreateFrom<T>{p});
+}
+
+// jump table indexed by OrderKind, one entry per type in OrderTypes
+using OrderFactory = std::unique_ptr<Order> (*)(const NewOrderParams&);
+
+template<OrderTypeRequirement... Ts>
+consteval auto factory_table(Types<Ts...>) {
+	return std::array<OrderFactory, sizeof...(Ts)>{ &make_order<Ts>... };
+}
+inline constexpr auto kOrderFactories = factory_table(OrderTypes{});
+
+// factory function for creating an order; nullptr for an unknown kind
 inline std::unique_ptr<Order>
-create_order(std::string_view kind, const NewOrderParams& p) {
-	Maker m{p};
-	dispatch_by_name(OrderTypes{}, kind, m);
-	return std::make_unique<Order>(std::move(m.out));
+create_order(OrderKind kind, const NewOrderParams& p) {
+	auto index = static_cast<size_t>(kind);
+	if (index >= kOrderKindCount) return nullptr;
+	return kOrderFactories[index](p);
 }
 
 #endif
@@ -1,32 +1,140 @@
 #ifndef ORDERBOOK_H
 #define ORDERBOOK_H
 
+#include <bit>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <memory_resource>
 #include <memory>
 #include <string>
 #include <algorithm>
+#include <optional>
+#include <functional>
+#include <limits>
 #include "order.h"
 #include "event_api.h"
+#include "timing_wheel.h"
+#include "allocation.h"
+#include "risk_manager.h"
 
-using Book = std::vector<std::unique_ptr<Order>>;
-using Handles = std::unordered_map<OrdId, OrderHandle>;
+inline constexpr OrdId kNoOrder = std::numeric_limits<OrdId>::max();
 
+// Handles double as the nodes of per-client intrusive lists (client_prev /
+// client_next), so a client's live orders can be walked without a scan
 struct OrderHandle {
     Side side;
     size_t vectorIndex;
+    OrdId client_prev{kNoOrder};
+    OrdId client_next{kNoOrder};
 };
 
+// Pending stops are keyed by trigger price so the triggered set is always a
+// prefix: buy stops ascending (fire when last >= stop), sell stops descending
+// (fire when last <= stop). Equal triggers keep arrival order.
+struct StopHandle {
+    Side side;
+    Px stop_price;
+    OrdId client_prev{kNoOrder};
+    OrdId client_next{kNoOrder};
+};
+
+// Containers allocate from the owning shard's arena (see shard.h)
+using Book = std::pmr::vector<std::unique_ptr<Order>>;
+using Handles = std::pmr::unordered_map<OrdId, OrderHandle>;
+using BuyStops = std::pmr::multimap<Px, std::unique_ptr<Order>, std::less<Px>>;
+using SellStops = std::pmr::multimap<Px, std::unique_ptr<Order>, std::greater<Px>>;
+using StopHandles = std::pmr::unordered_map<OrdId, StopHandle>;
+using ClientHeads = std::pmr::unordered_map<ClientId, OrdId>;
+
 class OrderBook {
 friend class MatchingEngine;
 public:
-    inline explicit OrderBook(const std::string& symbol) : symbol_(symbol) {}
+    inline explicit OrderBook(const std::string& symbol,
+                              std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : symbol_(symbol), bids_(memory), asks_(memory), order_handles_(memory), client_orders_(memory),
+          buy_stops_(memory), sell_stops_(memory), stop_handles_(memory), client_stops_(memory),
+          expiries_(expiry_tick(Clock::now())) {}
+
+    // Moves a book into other memory, e.g. when its symbol changes shard.
+    // The orders themselves are not copied; only the containers are rebuilt.
+    OrderBook(OrderBook&& other, std::pmr::memory_resource* memory)
+        : symbol_(std::move(other.symbol_)), now_(other.now_),
+          bids_(std::move(other.bids_), memory), asks_(std::move(other.asks_), memory),
+          order_handles_(std::move(other.order_handles_), memory),
+          client_orders_(std::move(other.client_orders_), memory),
+          buy_stops_(std::move(other.buy_stops_), memory), sell_stops_(std::move(other.sell_stops_), memory),
+          stop_handles_(std::move(other.stop_handles_), memory),
+          client_stops_(std::move(other.client_stops_), memory),
+          last_trade_price_(other.last_trade_price_), phase_(other.phase_),
+          expiries_(std::move(other.expiries_)), session_close_(other.session_close_),
+          allocation_(other.allocation_), top_bid_(other.top_bid_), top_ask_(other.top_ask_),
+          checksum_(other.checksum_), order_seq_(other.order_seq_), trade_seq_(other.trade_seq_),
+          match_seq_(other.match_seq_), risk_verdict_(other.risk_verdict_), replaying_(other.replaying_),
+          expired_(std::move(other.expired_)) {}
+
+    // One order's share of checksum_
+    static uint64_t order_hash(const OrderMeta& meta) {
+        auto mix = [](uint64_t x) {
+            x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        };
+        uint64_t qty_side = (static_cast<uint64_t>(meta.remaining_quantity) << 1) | (meta.side == Side::SELL);
+        return mix(meta.order_id + mix(std::bit_cast<uint64_t>(meta.price) + mix(qty_side)));
+    }
+
+    static TimingWheel::Tick expiry_tick(Timestamp ts) {
+        return Clock::toNanos(ts) / 1000000;
+    }
 
     std::string symbol_;
+    Timestamp now_{};  // ingress stamp of the request being processed
     Book bids_;  // Sorted: high price first, early time first
     Book asks_;  // Sorted: low price first, early time first
     Handles order_handles_;
+    ClientHeads client_orders_;  // head of each client's list in order_handles_
+
+    BuyStops buy_stops_;
+    SellStops sell_stops_;
+    StopHandles stop_handles_;
+    ClientHeads client_stops_;   // head of each client's list in stop_handles_
+    std::optional<Px> last_trade_price_;
+    TradingPhase phase_{TradingPhase::CONTINUOUS};
+
+    // DAY orders expire at session_close_; both kinds are scheduled here
+    TimingWheel expiries_;
+    Timestamp session_close_{Timestamp::max()};
+
+    // Level allocation for this symbol. The top order of a side is the last
+    // one to open a new best level; it keeps top-order priority only while
+    // it is still at the front of that level.
+    AllocationRules allocation_;
+    OrdId top_bid_{kNoOrder};
+    OrdId top_ask_{kNoOrder};
+
+    // Sum (mod 2^64) of order_hash over every resting order and parked stop,
+    // kept up to date on each change, so two books in the same state agree
+    // whatever order they got there in
+    uint64_t checksum_{0};
+
+    // Event sequences for this symbol. A book that is fed the same requests
+    // hands out the same numbers, so they survive a failover to a replica.
+    uint64_t order_seq_{0};
+    uint64_t trade_seq_{0};
+    uint64_t match_seq_{1000};
+
+    // Pre-trade risk verdict of the request being processed. The engine
+    // records each check here. A replica sets replaying_ and presets the
+    // primary's verdict instead: its own counters see other symbols' flow in
+    // a different interleaving, so a fresh check could disagree.
+    std::optional<RiskDecision> risk_verdict_;
+    bool replaying_{false};
+    // Orders expire_orders took off before the request being processed,
+    // in firing order. A replica is handed the primary's list instead of
+    // advancing its own wheel, which maps ticks to time with its own rate.
+    std::vector<OrdId> expired_;
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,77 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <variant>
+#include "request_api.h"
+
+enum class PerfEvent : uint8_t { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES };
+inline constexpr size_t kPerfEvents = 5;
+inline constexpr std::array<std::string_view, kPerfEvents> kPerfEventNames{
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+// Indexed like TradingRequest's alternatives
+inline constexpr size_t kRequestTypes = std::variant_size_v<TradingRequest>;
+inline constexpr std::array<std::string_view, kRequestTypes> kRequestTypeNames{
+    "new_order", "cancel", "modify", "mass_cancel", "trading_phase"};
+
+// Counter totals over a number of process_request calls
+struct PerfTotals {
+    uint64_t calls{0};
+    std::array<uint64_t, kPerfEvents> counts{};
+
+    double perCall(PerfEvent event) const {
+        return calls ? static_cast<double>(counts[static_cast<size_t>(event)]) / static_cast<double>(calls) : 0.0;
+    }
+    double ipc() const {
+        uint64_t cycles = counts[static_cast<size_t>(PerfEvent::CYCLES)];
+        return cycles ? static_cast<double>(counts[static_cast<size_t>(PerfEvent::INSTRUCTIONS)]) / static_cast<double>(cycles) : 0.0;
+    }
+    PerfTotals& operator+=(const PerfTotals& other) {
+        calls += other.calls;
+        for (size_t i = 0; i < kPerfEvents; ++i) counts[i] += other.counts[i];
+        return *this;
+    }
+};
+
+// Hardware counters of one thread, opened with perf_event_open as a single
+// group (user space only, so perf_event_paranoid 2 is enough) and read with
+// one read() per sample. Events the CPU or hypervisor lacks stay at zero;
+// if even cycles can't be opened, nothing is counted and every call is a
+// no-op. Totals are kept per request type by the owning thread and can be
+// read from any thread.
+class PerfCounters {
+public:
+    using Reading = std::array<uint64_t, kPerfEvents>;
+
+    // Counts the calling thread
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return leader_ >= 0; }
+    bool opened(PerfEvent event) const { return fds_[static_cast<size_t>(event)] >= 0; }
+
+    // Owning thread: read before the call, then record what it took
+    bool read(Reading& out) const;
+    void record(size_t requestType, const Reading& before);
+
+    std::array<PerfTotals, kRequestTypes> totals() const;
+
+private:
+    struct alignas(64) Totals {
+        std::atomic<uint64_t> calls{0};
+        std::array<std::atomic<uint64_t>, kPerfEvents> counts{};
+    };
+
+    int leader_{-1};
+    std::array<int, kPerfEvents> fds_;
+    std::array<uint64_t, kPerfEvents> ids_{};
+    std::array<Totals, kRequestTypes> totals_;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "order.h"
+#include "request_api.h"
+#include "allocation.h"
+#include "risk_manager.h"
+
+// Primary/backup replication of the sequenced request stream. The primary
+// sends every request each symbol's strand processes, in strand order, with
+// everything else that changes a book (listings, session close, allocation
+// rules), the primary's pre-trade risk verdict and the orders it expired
+// ahead of each request. The backup runs the frames through its own
+// MatchingEngine with the primary's ingress stamps and decisions, so its
+// books, event sequences and journal come out the same, and it
+// checks each book against the primary's checksum as it goes. Promoting it
+// is a matter of letting the last frames drain; there is nothing to rebuild.
+
+enum class ReplicationMode {
+    ASYNC,  // acks never wait for the backup
+    SYNC    // a request completes only once the backup has acknowledged it
+};
+
+struct ReplicationConfig {
+    ReplicationMode mode = ReplicationMode::ASYNC;
+    // Producers block once this many bytes are waiting to be sent
+    size_t max_queued_bytes = size_t{64} << 20;
+};
+
+// Ordered, reliable byte stream between the two ends. Each end has one
+// sending and one receiving thread, which may use it concurrently.
+class ReplicationTransport {
+public:
+    virtual ~ReplicationTransport() = default;
+    // All of it, or false once the peer is gone
+    virtual bool send(const char* data, size_t length) = 0;
+    // Blocks for at least one byte; 0 once the peer is gone or after close()
+    virtual size_t receive(char* data, size_t capacity) = 0;
+    // Wakes a blocked receive; what was already sent is still delivered
+    virtual void close() = 0;
+};
+
+// Stream socket in the UNIX domain, for a backup on the same host. Errors
+// setting it up throw std::system_error.
+class UnixSocketTransport : public ReplicationTransport {
+public:
+    explicit UnixSocketTransport(int fd) : fd_(fd) {}
+    ~UnixSocketTransport() override;
+
+    // Binds path and blocks until one peer connects
+    static std::unique_ptr<UnixSocketTransport> listen(const std::string& path);
+    static std::unique_ptr<UnixSocketTransport> connect(const std::string& path);
+    // Both ends of an unnamed pair, e.g. for a backup in the same process
+    static std::pair<std::unique_ptr<UnixSocketTransport>, std::unique_ptr<UnixSocketTransport>> pair();
+
+    bool send(const char* data, size_t length) override;
+    size_t receive(char* data, size_t capacity) override;
+    void close() override;
+
+private:
+    int fd_;
+};
+
+namespace replication {
+
+enum class FrameType : uint8_t {
+    REQUEST = 1,
+    LIST = 2,           // symbol, allocation rules and session close
+    DELIST = 3,
+    SESSION_CLOSE = 4,
+    ALLOCATION = 5
+};
+
+// Every frame: this header, then a body that depends on the type. Timestamps
+// are the primary's raw Clock ticks. The backup only stamps and compares
+// with them; it never turns them into time with its own calibration, which
+// is why expiries are replicated rather than recomputed.
+#pragma pack(push, 1)
+struct FrameHeader {
+    uint32_t  length;     // whole frame
+    FrameType type;
+    uint8_t   risk;       // REQUEST: 0 no check ran, 1 accepted, 2 rejected
+    uint16_t  reserved;
+    SymbolId  symbol_id;
+    uint64_t  seq;        // stream position, from 1
+    uint64_t  ingress;
+    uint64_t  checksum;   // the primary's book once the frame is applied
+};
+#pragma pack(pop)
+
+struct FrameMeta {
+    FrameType type;
+    SymbolId symbol_id;
+    Timestamp ingress{};
+    uint64_t checksum{0};
+    std::optional<RiskDecision> risk;
+};
+
+// A decoded frame; only the fields of its type are set
+struct Frame : FrameMeta {
+    uint64_t seq{0};
+    std::string breach;  // a rejecting verdict's breach; risk->breach is empty
+    std::optional<TradingRequest> request;  // symbol left empty
+    std::vector<OrdId> expired;  // REQUEST: what the primary expired just before it
+    Symb symbol;
+    AllocationRules allocation;
+    Timestamp session_close{Timestamp::max()};
+};
+
+// Frame bodies. A request is encoded before the engine consumes it.
+void encode_request(std::vector<char>& body, const TradingRequest& request);
+// Appended to a request's body once the primary has processed it
+void encode_expired(std::vector<char>& body, const std::vector<OrdId>& expired);
+void encode_listing(std::vector<char>& body, const Symb& symbol, const AllocationRules& allocation, Timestamp sessionClose);
+void encode_allocation(std::vector<char>& body, const AllocationRules& allocation);
+void encode_session_close(std::vector<char>& body, Timestamp close);
+
+// Size of the frame at data once its length field has arrived, else 0
+size_t frame_length(const char* data, size_t available);
+std::optional<Frame> decode(const char* data, size_t length);
+
+} // namespace replication
+
+// Primary side. The strands append frames to a queue under one short lock,
+// which fixes their stream order; a sender thread writes whatever has
+// accumulated in one send, so frames batch up under load the way the
+// journal does. The backup acknowledges cumulatively; an ack thread advances
+// the watermark and runs the callbacks waiting on it. If the backup goes
+// away the primary carries on alone and every waiter is released.
+class Replicator {
+public:
+    using AckCallback = std::function<void()>;
+
+    Replicator(std::unique_ptr<ReplicationTransport> transport, ReplicationConfig config = {});
+    ~Replicator();
+
+    // Returns the frame's stream sequence, 0 once the backup is gone
+    uint64_t append(const replication::FrameMeta& meta, const std::vector<char>& body);
+
+    // Runs callback on the ack thread once seq is acknowledged, or right
+    // away if it already is or the backup is gone
+    void whenAcked(uint64_t seq, AckCallback callback);
+    uint64_t ackedSequence() const { return acked_.load(std::memory_order_acquire); }
+    bool connected() const { return !lost_.load(std::memory_order_acquire); }
+    ReplicationMode mode() const { return config_.mode; }
+
+    // Sends what is queued, ends the stream and releases every waiter
+    void shutdown();
+
+private:
+    void sendLoop();
+    void ackLoop();
+    void lose(const char* why);
+    void release(uint64_t upto);
+
+    std::unique_ptr<ReplicationTransport> transport_;
+    ReplicationConfig config_;
+
+    std::vector<char> queue_;
+    uint64_t nextSeq_{1};  // under queueMutex_
+    std::mutex queueMutex_;
+    std::condition_variable queueCondition_;
+    std::condition_variable spaceCondition_;
+    bool stopping_{false};
+    std::atomic<bool> lost_{false};
+
+    std::atomic<uint64_t> acked_{0};
+    std::multimap<uint64_t, AckCallback> pendingAcks_;  // by sequence
+    std::mutex ackMutex_;
+
+    std::thread sendThread_;
+    std::thread ackThread_;
+};
+
+// Backup side. Reads frames off the transport on its own thread, hands each
+// to apply in stream order and acknowledges every batch once apply has
+// taken it; apply sequences the frame onto its symbol's strand and returns.
+class ReplicaReceiver {
+public:
+    using Apply = std::function<void(replication::Frame&&)>;
+
+    ReplicaReceiver(std::unique_ptr<ReplicationTransport> transport, Apply apply);
+    ~ReplicaReceiver();
+
+    // Stops reading and returns once the thread is done with apply
+    void stop();
+    uint64_t received() const { return received_.load(std::memory_order_acquire); }
+    // The stream skipped a sequence or could not be decoded
+    bool broken() const { return broken_.load(std::memory_order_acquire); }
+
+private:
+    void receiveLoop();
+
+    std::unique_ptr<ReplicationTransport> transport_;
+    Apply apply_;
+    std::atomic<uint64_t> received_{0};
+    std::atomic<bool> broken_{false};
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+#endif
@@ -12,21 +12,25 @@ using ReqId = uint64_t;
 struct NewOrderRequest {
     ReqId request_id{};
     Symb symbol;
-    std::string order_type;
+    OrderKind order_type;
     NewOrderParams params;
 
-    NewOrderRequest(Symb sym, std::string type, NewOrderParams p)
-        : symbol(std::move(sym)), order_type(std::move(type)), params(std::move(p)) {}
+    NewOrderRequest(Symb sym, OrderKind type, NewOrderParams p)
+        : symbol(std::move(sym)), order_type(type), params(std::move(p)) {}
+    NewOrderRequest(Symb sym, std::string_view type, NewOrderParams p)
+        : NewOrderRequest(std::move(sym), order_kind_from_name(type), std::move(p)) {}
 
 };
 
+// client_id, when set, must own the order; gateways always set it
 struct CancelOrderRequest {
     ReqId request_id{};
     Symb symbol;
     OrdId order_id;
+    std::optional<ClientId> client_id;
     
-    CancelOrderRequest(Symb sym, OrdId id)
-        : symbol(std::move(sym)), order_id(id) {}
+    CancelOrderRequest(Symb sym, OrdId id, std::optional<ClientId> client = std::nullopt)
+        : symbol(std::move(sym)), order_id(id), client_id(std::move(client)) {}
 };
 
 struct ModifyOrderRequest {
@@ -35,12 +39,37 @@ struct ModifyOrderRequest {
     OrdId order_id;
     Px new_price;
     Qty new_quantity;
+    std::optional<ClientId> client_id;
     
-    ModifyOrderRequest(Symb sym, OrdId id, Px px, Qty qty)
-        : symbol(std::move(sym)), order_id(id), new_price(px), new_quantity(qty) {}
+    ModifyOrderRequest(Symb sym, OrdId id, Px px, Qty qty, std::optional<ClientId> client = std::nullopt)
+        : symbol(std::move(sym)), order_id(id), new_price(px), new_quantity(qty), client_id(std::move(client)) {}
 };
 
-using TradingRequest = std::variant<NewOrderRequest, CancelOrderRequest, ModifyOrderRequest>;
+// Cancels every resting and pending stop order in the symbol, optionally
+// narrowed to one client and/or one side
+struct MassCancelRequest {
+    ReqId request_id{};
+    Symb symbol;
+    std::optional<ClientId> client_id;
+    std::optional<Side> side;
+
+    MassCancelRequest(Symb sym, std::optional<ClientId> client = std::nullopt, std::optional<Side> s = std::nullopt)
+        : symbol(std::move(sym)), client_id(std::move(client)), side(s) {}
+};
+
+// Moves a symbol between trading phases. Leaving CALL_AUCTION uncrosses the
+// book, so CALL_AUCTION -> CONTINUOUS is an opening cross and
+// CALL_AUCTION -> CLOSED a closing cross.
+struct TradingPhaseRequest {
+    ReqId request_id{};
+    Symb symbol;
+    TradingPhase phase;
+
+    TradingPhaseRequest(Symb sym, TradingPhase p)
+        : symbol(std::move(sym)), phase(p) {}
+};
+
+using TradingRequest = std::variant<NewOrderRequest, CancelOrderRequest, ModifyOrderRequest, MassCancelRequest, TradingPhaseRequest>;
 
 inline OrdId generate_order_id() {
     static std::atomic<OrdId> counter{1000};
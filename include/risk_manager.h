@@ -0,0 +1,77 @@
+#ifndef RISK_MANAGER_H
+#define RISK_MANAGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include "client_table.h"
+#include "order.h"
+
+struct RiskLimits {
+    Qty      max_order_qty = std::numeric_limits<Qty>::max();
+    double   max_notional = std::numeric_limits<double>::infinity();
+    int64_t  max_open_orders = std::numeric_limits<int64_t>::max();
+    int64_t  max_net_position = std::numeric_limits<int64_t>::max();  // absolute, in units
+};
+
+struct RiskDecision {
+    bool accepted{true};
+    std::string_view breach;  // which limit, when rejected
+};
+
+struct RiskConfig {
+    size_t max_clients = 4096;  // clients tracked at once; idle ones give up their slot
+    RiskLimits defaults{};      // for clients without explicit limits
+};
+
+// Pre-trade limits per client. Every strand shares one instance, so all state
+// lives in a ClientTable: lookups, lazy registration and counter updates are
+// plain atomics and never take a lock. A client with no open orders, a flat
+// position and default limits has nothing worth keeping, so its slot can go
+// to another client. A client that finds no slot at all is checked against
+// the default limits alone; sessions pin their slot at logon instead.
+class RiskManager {
+public:
+    explicit RiskManager(size_t capacity = 4096, RiskLimits defaults = {});
+    explicit RiskManager(const RiskConfig& config) : RiskManager(config.max_clients, config.defaults) {}
+
+    // false when the table has no room for the client
+    bool setLimits(const ClientId& client, const RiskLimits& limits);
+
+    // ref_price is the order's limit, or a reference price for market/stop orders.
+    // A replacing order is already open, so it is not counted again.
+    RiskDecision check(const ClientId& client, Side side, Px ref_price, Qty qty, bool replacing = false);
+
+    void onOrderOpened(const ClientId& client);
+    void onOrderClosed(const ClientId& client);
+    void onFill(const ClientId& client, Side side, Qty qty);
+
+    int64_t netPosition(const ClientId& client);
+    int64_t openOrders(const ClientId& client);
+
+    // Keeps a logged-on client's slot until it logs off; false when full
+    bool pin(const ClientId& client) { return table_.pin(client); }
+    void unpin(const ClientId& client) { table_.unpin(client); }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> key{0};  // 0 = free
+        std::atomic<int64_t>  users{0};
+        std::atomic<bool>     explicit_limits{false};
+        std::atomic<Qty>      max_order_qty{};
+        std::atomic<double>   max_notional{};
+        std::atomic<int64_t>  max_open_orders{};
+        std::atomic<int64_t>  max_net_position{};
+        std::atomic<int64_t>  net_position{0};
+        std::atomic<int64_t>  open_orders{0};
+    };
+
+    static void storeLimits(Slot& slot, const RiskLimits& limits);
+
+    RiskLimits defaults_;
+    ClientTable<Slot> table_;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include "thread_pool.h"
+#include "perf_counters.h"
+
+struct ShardConfig {
+    size_t arena_bytes = size_t{32} << 20;  // per shard, reserved and pre-faulted up front
+    bool huge_pages = true;                 // try MAP_HUGETLB, then transparent huge pages
+    bool pin_threads = true;                // pin shard i to the i-th CPU we may run on
+
+    // Load balancing: every interval (0 = never), the busiest shard hands
+    // one symbol to the idlest. That happens only if the busiest shard runs
+    // at least rebalance_min_rate requests/s, its rate is at least
+    // rebalance_ratio times the idlest shard's rate, and the move lowers the
+    // peak.
+    std::chrono::milliseconds rebalance_interval{1000};
+    double rebalance_ratio = 1.5;
+    double rebalance_min_rate = 1000.0;
+
+    // Profiling: hardware counters on each shard thread, sampled around
+    // every process_request (two extra syscalls per request)
+    bool perf_counters = false;
+};
+
+// Fixed region carved out once and handed out by bumping a pointer. It is
+// placed on a NUMA node and pre-faulted, so nothing allocated from it takes a
+// page fault or a remote access later. Frees are ignored; put a pool resource
+// on top to recycle. Once the region is used up, allocations spill to the
+// global heap.
+class ShardArena : public std::pmr::memory_resource {
+public:
+    // node < 0: leave placement to first touch by the calling thread
+    ShardArena(size_t bytes, bool huge_pages, int node);
+    ~ShardArena() override;
+
+    ShardArena(const ShardArena&) = delete;
+    ShardArena& operator=(const ShardArena&) = delete;
+
+    bool hugePages() const { return hugePages_; }
+    size_t capacity() const { return size_; }
+    // Readable from any thread
+    size_t used() const { return used_.load(std::memory_order_relaxed); }
+    size_t spilled() const { return spilled_.load(std::memory_order_relaxed); }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    char* base_{nullptr};
+    size_t size_{0};
+    std::atomic<size_t> used_{0};     // written by the owning thread only
+    std::atomic<size_t> spilled_{0};
+    bool hugePages_{false};
+};
+
+// One matching thread and the memory of the symbols it owns. The thread is
+// pinned first; the arena is then created and faulted in from that thread,
+// so its pages land on the thread's node. Books take their containers from
+// memory(), which must only be used on the shard thread (or once it has
+// stopped).
+class Shard {
+public:
+    Shard(size_t index, const ShardConfig& config);
+    ~Shard();
+
+    size_t index() const { return index_; }
+    ThreadPool& pool() { return pool_; }
+    std::pmr::memory_resource* memory() { return pool_resource_.get(); }
+    const ShardArena& arena() const { return *arena_; }
+    // Null unless ShardConfig::perf_counters is set and the kernel allowed them
+    PerfCounters* perf() const { return perf_.get(); }
+    int cpu() const { return cpu_; }
+    int node() const { return node_; }
+
+    // Runs f on the shard thread and waits for it
+    void run(const std::function<void()>& f);
+    void shutdown() { pool_.shutdown(); }
+
+private:
+    size_t index_;
+    ThreadPool pool_{1};
+    int cpu_{-1};
+    int node_{-1};
+    std::unique_ptr<ShardArena> arena_;
+    std::unique_ptr<std::pmr::unsynchronized_pool_resource> pool_resource_;
+    std::unique_ptr<PerfCounters> perf_;
+};
+
+#endif
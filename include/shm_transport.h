@@ -0,0 +1,292 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "exchange.h"
+#include "wire_protocol.h"
+
+// Same-host transport: the exchange ingress and its execution/market data
+// output as lock-free rings in one POSIX shared memory segment. Clients speak
+// the wire_protocol.h messages through their own request/report ring pair,
+// so the fast path on either side is a few atomics and a memcpy, no syscalls.
+namespace shm {
+
+inline constexpr uint64_t kMagic = 0x4f42534d454d0001;  // "OBSMEM", layout 1
+inline constexpr size_t kSlotBytes = 128;
+inline constexpr size_t kRequestSlots = 1024;
+inline constexpr size_t kReportSlots = 4096;
+inline constexpr size_t kMarketDataSlots = 16384;
+inline constexpr size_t kMaxClients = 32;
+
+// Bounded ring of fixed-size message slots with per-slot sequence numbers.
+// A slot at position p is free for a producer when seq == p and holds a
+// message when seq == p + 1. Producers claim positions with a CAS, so any
+// number may push; there is a single consumer.
+template<size_t N>
+struct MessageRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+    static constexpr size_t kPayload = kSlotBytes - sizeof(uint64_t) - sizeof(uint32_t);
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq;
+        uint32_t length;
+        char data[kPayload];
+    };
+
+    alignas(64) std::atomic<uint64_t> head;  // next position to claim
+    alignas(64) std::atomic<uint64_t> tail;  // next position to consume
+    Slot slots[N];
+
+    void reset() {
+        for (size_t i = 0; i < N; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_release);
+    }
+
+    // false when full or the message does not fit a slot
+    bool push(const char* data, size_t length) {
+        if (length > kPayload) return false;
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[pos & (N - 1)];
+            int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->length = static_cast<uint32_t>(length);
+        std::memcpy(slot->data, data, length);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Hands the next message to consume(data, length); false when empty
+    template<class F>
+    bool pop(F&& consume) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        Slot& slot = slots[pos & (N - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != pos + 1) return false;
+        consume(static_cast<const char*>(slot.data), static_cast<size_t>(slot.length));
+        slot.seq.store(pos + N, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+struct MarketDataEvent {
+    enum Type : uint8_t { TRADE = 1, TOP_OF_BOOK = 2 };
+
+    Type     type;
+    uint8_t  taker_is_buy;   // TRADE
+    uint16_t reserved;
+    SymbolId symbol_id;
+    int64_t  ts_ns;          // wall clock (Clock ticks in the ring); TRADE only
+    uint64_t match_seq;      // TRADE
+    double   price;          // TRADE
+    uint32_t qty;            // TRADE
+    uint32_t reserved2;
+    double   bid_price;      // TOP_OF_BOOK; qty 0 = empty side
+    double   ask_price;
+    uint32_t bid_qty;
+    uint32_t ask_qty;
+};
+
+// One writer position counter, many independent readers. Each slot is a
+// seqlock: odd while being written, 2 * (pos + 1) once it holds position
+// pos. A reader that falls a full ring behind sees a newer sequence and
+// skips ahead instead of stalling the publisher.
+template<size_t N>
+struct BroadcastRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq;
+        MarketDataEvent event;
+    };
+
+    alignas(64) std::atomic<uint64_t> head;
+    Slot slots[N];
+
+    void reset() {
+        for (size_t i = 0; i < N; ++i) slots[i].seq.store(0, std::memory_order_relaxed);
+        head.store(0, std::memory_order_release);
+    }
+
+    void publish(const MarketDataEvent& event) {
+        uint64_t pos = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots[pos & (N - 1)];
+        slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.event, &event, sizeof(event));
+        slot.seq.store(2 * pos + 2, std::memory_order_release);
+    }
+
+    enum class Read { EMPTY, OK, LAPPED };
+
+    Read read(uint64_t& pos, MarketDataEvent& out) const {
+        const Slot& slot = slots[pos & (N - 1)];
+        uint64_t expected = 2 * pos + 2;
+        uint64_t before = slot.seq.load(std::memory_order_acquire);
+        if (before < expected) return Read::EMPTY;
+        if (before == expected) {
+            std::memcpy(&out, &slot.event, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == expected) {
+                ++pos;
+                return Read::OK;
+            }
+        }
+        // Overwritten: resume from the oldest position still intact
+        uint64_t newest = head.load(std::memory_order_acquire);
+        pos = newest > N / 2 ? newest - N / 2 : 0;
+        return Read::LAPPED;
+    }
+};
+
+// A reaped channel still belongs to its client process: it only becomes FREE
+// once that client lets go of it (pid 0) or dies, so a live client whose
+// session the server closed can never share a channel with the next owner.
+enum ChannelState : uint32_t { FREE, CLAIMED, ACTIVE, CLOSING, REAPED };
+
+struct ClientChannel {
+    alignas(64) std::atomic<uint32_t> state;
+    std::atomic<uint32_t> generation;  // bumped every time the channel is reaped
+    std::atomic<int32_t>  pid;         // 0 once the client has let go
+    std::atomic<int64_t>  heartbeat_ns;  // CLOCK_MONOTONIC
+    char client_id[wire::kClientIdLength];
+    MessageRing<kRequestSlots> requests;  // client -> exchange
+    MessageRing<kReportSlots> reports;    // exchange -> client
+};
+
+struct Segment {
+    uint64_t magic;
+    uint32_t max_clients;
+    std::atomic<uint32_t> server_up;
+    std::atomic<int32_t>  server_pid;
+    std::atomic<int64_t>  server_heartbeat_ns;
+    BroadcastRing<kMarketDataSlots> market_data;
+    ClientChannel clients[kMaxClients];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared rings need address-free atomics");
+
+inline int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace shm
+
+// Exchange side. Creates the segment, busy-polls every active client's
+// request ring on one thread and publishes trades and top of book to the
+// market data ring. A housekeeping thread beats the server heartbeat and
+// reaps clients whose process is gone, whose heartbeat is stale or who
+// disconnected; by default their orders are mass cancelled first. A reaped
+// channel is only reused once its client has gone away. A client
+// that lets its report ring fill up is treated as disconnected too, so a
+// completion never waits for a reader.
+// Installs the exchange's market data sink. The mapping is shared with the
+// sink and with in-flight completions, so it stays valid until the last of
+// them lets go.
+class ShmServer {
+public:
+    struct Config {
+        std::chrono::milliseconds heartbeat_timeout{5000};
+        bool cancel_on_disconnect{true};
+    };
+
+    ShmServer(Exchange& exchange, std::string name, Config config);
+    ShmServer(Exchange& exchange, std::string name) : ShmServer(exchange, std::move(name), Config{}) {}
+    ~ShmServer();
+
+    void shutdown();
+    size_t activeClients() const;
+
+private:
+    // Poll thread's cache of who holds each channel
+    struct Channel {
+        ClientId client;
+        uint32_t generation{UINT32_MAX};
+        std::atomic<bool> attached{false};  // Exchange::attachClient; cleared by the reaper
+    };
+
+    void pollLoop();
+    void housekeepingLoop();
+    bool peerDead(const shm::ClientChannel& channel, int64_t now) const;
+    void reap(shm::ClientChannel& channel);
+    Exchange::Completion reportTo(size_t index, uint32_t generation);
+
+    Exchange& exchange_;
+    std::string name_;
+    Config config_;
+    std::shared_ptr<shm::Segment> segment_;
+    std::vector<Channel> channels_;
+    std::atomic<uint64_t> pollPasses_{0};
+    std::atomic<bool> stop_{false};
+    std::thread pollThread_;
+    std::thread housekeepingThread_;
+};
+
+// Strategy side of a ShmServer segment. Not thread-safe: one instance per
+// thread that trades.
+class ShmClient {
+public:
+    ShmClient(const std::string& name, const ClientId& client);
+    ~ShmClient();
+
+    // Any request message from wire_protocol.h; false when the ring is full,
+    // the server is gone or it has closed this session
+    template<class Msg>
+    bool send(const Msg& msg) { return sendRaw(reinterpret_cast<const char*>(&msg), sizeof(msg)); }
+
+    // Hands the next execution report and its fills to f(report, fills);
+    // false when there is none or the session is closed
+    template<class F>
+    bool pollReport(F&& f) {
+        if (!connected()) return false;
+        heartbeat();
+        return channel_->reports.pop([&f](const char* data, size_t length) {
+            const auto* report = wire::view<wire::ExecReport>(data, length);
+            f(*report, reinterpret_cast<const wire::ExecFill*>(data + sizeof(wire::ExecReport)));
+        });
+    }
+
+    bool pollMarketData(shm::MarketDataEvent& out);
+    // Times this reader fell a ring behind and skipped ahead
+    uint64_t marketDataGaps() const { return gaps_; }
+
+    bool serverAlive() const;
+    // Whether the server still runs this session. Once it has closed it (slow
+    // reader, bad message or missed heartbeat) the channel stays unusable
+    // until this client is destroyed; reconnect with a new ShmClient.
+    bool connected() const {
+        return channel_->state.load(std::memory_order_acquire) == shm::ACTIVE &&
+               channel_->generation.load(std::memory_order_acquire) == generation_;
+    }
+    // send and poll beat on their own; an idle client must call this at
+    // least once per heartbeat_timeout
+    void heartbeat() { channel_->heartbeat_ns.store(shm::monotonic_ns(), std::memory_order_relaxed); }
+
+private:
+    bool sendRaw(const char* data, size_t length);
+
+    shm::Segment* segment_{nullptr};
+    shm::ClientChannel* channel_{nullptr};
+    uint32_t generation_{0};  // of channel_ when this client registered
+    uint64_t marketDataPos_{0};
+    uint64_t gaps_{0};
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define STRAND_H
 
 #include "thread_pool.h"
+#include "clock.h"
 #include <functional>
 #include <queue>
 #include <mutex>
@@ -13,12 +14,26 @@ public:
     
     // Post a task to be executed in this strand (serialized)
     void post(std::function<void()> task);
+
+    // Moves the strand to another pool. Only valid from a task running on
+    // this strand; the tasks after it run on the new pool, still in order.
+    void rebind(ThreadPool& threadPool);
+
+    // Tasks posted but not yet started
+    size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+    // When the running task was handed to the pool: it waited in the
+    // strand's queue before this and for a pool thread after. Only
+    // meaningful from inside a task.
+    Timestamp scheduled() const { return scheduled_; }
     
 private:
-    ThreadPool& threadPool_;
+    ThreadPool* threadPool_;
     std::queue<std::function<void()>> taskQueue_;
     std::mutex mutex_;
     std::atomic<bool> running_{false};
+    std::atomic<size_t> pending_{0};
+    Timestamp scheduled_{};  // under mutex_; read by the task it precedes
     
     void executeNext();
 };
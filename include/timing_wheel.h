@@ -0,0 +1,54 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "order.h"
+
+// Hierarchical timing wheel for order expiry: 4 levels of 256 slots at 1ms
+// per tick covers ~49 days; anything further out parks in the last top-level
+// slot and is re-placed as the wheel turns. Scheduling is O(1); each tick
+// fires at most one level-0 slot and, every 256 ticks, redistributes one
+// slot of the level above.
+//
+// Entries are never removed early. Cancels and fills leave a stale entry
+// behind and the owner checks the id against its index when it fires.
+class TimingWheel {
+public:
+    using Tick = uint64_t;
+    using ExpiryCallback = std::function<void(OrdId, Tick)>;
+
+    explicit TimingWheel(Tick start_tick) : current_(start_tick) {}
+
+    void schedule(OrdId id, Tick deadline);
+
+    // Fire everything due up to and including now
+    void advance(Tick now, const ExpiryCallback& on_expire);
+
+    size_t pending() const { return count_; }
+    Tick current() const { return current_; }
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 8;
+    static constexpr Tick kSlots = Tick{1} << kSlotBits;
+    static constexpr Tick kSlotMask = kSlots - 1;
+
+    struct Entry {
+        OrdId id;
+        Tick deadline;
+    };
+    using Slot = std::vector<Entry>;
+
+    void place(const Entry& entry, Tick due);
+    void cascade(int level);
+
+    std::array<std::array<Slot, kSlots>, kLevels> levels_;
+    std::array<size_t, kLevels> level_counts_{};
+    size_t count_{0};
+    Tick current_;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "order.h"
+
+struct TraceConfig {
+    bool enabled = false;
+    uint32_t sample_every = 1000;  // one request in this many is traced
+    size_t ring_spans = 16384;     // per thread, rounded up to a power of two
+    // A request slower than this end to end dumps every ring to
+    // dump_directory, at most once per min_dump_interval; 0 = on demand only
+    std::chrono::microseconds dump_threshold{0};
+    std::chrono::milliseconds min_dump_interval{1000};
+    std::string dump_directory = "logs_internal/traces/";
+};
+
+// One stage of one request, on the thread that recorded it
+struct TraceSpan {
+    const char* name;  // a string literal
+    Timestamp begin;
+    Timestamp end;
+    uint64_t request_id;
+    SymbolId symbol;
+};
+
+// Sampled request tracing. Each thread records into its own ring of the
+// last ring_spans spans, written without locks or allocation; older spans
+// are overwritten. A dump reads every ring (slot by slot, each a seqlock, so
+// writers never wait) and writes Chrome trace_event JSON for Perfetto or
+// chrome://tracing. Slow requests trigger a dump from a thread of its own.
+class Tracer {
+public:
+    explicit Tracer(TraceConfig config = {});
+    ~Tracer();
+
+    bool enabled() const { return config_.enabled; }
+    // Whether to trace the next request submitted from this thread
+    bool sample();
+    void record(const TraceSpan& span);
+    // Every request's end-to-end latency, when enabled
+    void onLatency(Timestamp ingress, Timestamp done);
+
+    // What the rings hold now
+    void write(std::ostream& out) const;
+    // Same, to a new file under dump_directory; returns its path, or empty
+    // if it could not be written
+    std::string dump();
+    uint64_t dumps() const { return dumps_.load(std::memory_order_relaxed); }
+
+private:
+    struct Ring;
+
+    Ring& ring();
+    void dumpLoop();
+
+    TraceConfig config_;
+    uint64_t id_;  // tells apart tracers at the same address over time
+    uint64_t thresholdTicks_;
+    mutable std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;  // only ever added to
+
+    std::atomic<int64_t> lastDumpNs_{0};
+    std::atomic<uint64_t> dumps_{0};
+    std::mutex dumpMutex_;
+    std::condition_variable dumpWake_;
+    bool dumpWanted_{false};
+    bool stop_{false};
+    std::thread dumpThread_;
+};
+
+namespace tracing {
+
+struct Context {
+    Tracer* tracer;
+    uint64_t request_id;
+    SymbolId symbol;
+};
+
+// The sampled request the thread is processing; null for all others
+inline thread_local const Context* current = nullptr;
+
+// Records its own lifetime as a span of the current request. When the
+// request is not sampled this is a thread-local load and a branch.
+class Span {
+public:
+    explicit Span(const char* name) : context_(current), name_(name) {
+        if (context_) begin_ = Clock::now();
+    }
+    ~Span() {
+        if (context_) {
+            context_->tracer->record(TraceSpan{name_, begin_, Clock::now(), context_->request_id, context_->symbol});
+        }
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const Context* context_;
+    const char* name_;
+    Timestamp begin_{};
+};
+
+} // namespace tracing
+
+#endif
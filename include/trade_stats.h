@@ -0,0 +1,84 @@
+#ifndef TRADE_STATS_H
+#define TRADE_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "event_api.h"
+
+struct OhlcvBar {
+    int64_t  start_ns;   // wall clock, aligned to a multiple of the interval
+    Px       open;
+    Px       high;
+    Px       low;
+    Px       close;
+    uint64_t volume;
+    double   notional;
+    uint64_t trades;
+
+    double vwap() const { return volume ? notional / static_cast<double>(volume) : 0.0; }
+};
+
+// Since the symbol was listed
+struct TradeSummary {
+    uint64_t trades;
+    uint64_t volume;
+    double   notional;
+    Px       open;
+    Px       high;
+    Px       low;
+    Px       last;
+    Qty      last_qty;
+    int64_t  last_trade_ns;  // wall clock; 0 before the first trade
+
+    double vwap() const { return volume ? notional / static_cast<double>(volume) : 0.0; }
+};
+
+struct StatsConfig {
+    // Up to TradeStatistics::kMaxIntervals; extra ones are ignored
+    std::vector<std::chrono::milliseconds> bar_intervals{std::chrono::seconds(1), std::chrono::minutes(1)};
+};
+
+// Per-symbol trade statistics, updated in O(1) per fill by the symbol's
+// strand and read from any thread. Everything is plain data behind one
+// seqlock: the writer never waits, and a reader that overlaps a write
+// copies again.
+class TradeStatistics {
+public:
+    static constexpr size_t kMaxIntervals = 4;
+    static constexpr size_t kHistory = 64;  // completed bars kept per interval
+
+    explicit TradeStatistics(const StatsConfig& config);
+
+    // Writer side: the owning strand only
+    void onFill(const Fill& fill);
+
+    TradeSummary summary() const;
+    // Up to count bars of the given interval, oldest first, ending with the
+    // bar in progress; empty for an interval that was not configured
+    std::vector<OhlcvBar> bars(std::chrono::milliseconds interval, size_t count) const;
+
+private:
+    struct Series {
+        int64_t  interval_ns;
+        uint64_t interval_ticks;
+        int64_t  origin_ns;     // a bar boundary before the first fill
+        uint64_t origin_ticks;  // the same instant in Clock ticks
+        uint64_t completed;  // bars pushed to history so far
+        OhlcvBar current;    // start_ns 0 until the first trade
+        std::array<OhlcvBar, kHistory> history;
+    };
+
+    template<class F>
+    void read(F&& copy) const;
+
+    alignas(64) std::atomic<uint64_t> seq_{0};  // odd while a fill is being applied
+    size_t intervals_{0};
+    TradeSummary summary_{};  // last_trade_ns filled in by summary()
+    uint64_t lastTradeTicks_{0};
+    std::array<Series, kMaxIntervals> series_{};
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef TRADE_STORE_H
+#define TRADE_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "event_api.h"
+
+// Columnar trade history, one directory per symbol and UTC day:
+//   <root>/<symbol>/<YYYYMMDD>/{ts,price,qty,taker,maker,side}.col + index.bin
+// Rows are cut into blocks of up to kBlockRows. The index holds one entry per
+// block (its base time and row range) and is the sparse time index; ts.col
+// stores each row as a 32-bit nanosecond delta from its block's base, so a
+// block also closes early when that delta would overflow (~4.3s). The other
+// columns are fixed-width arrays that a scan can stream through directly.
+namespace trade_store {
+
+inline constexpr uint32_t kBlockRows = 4096;
+
+struct IndexEntry {
+    int64_t  base_ns;    // wall clock of the block's first row
+    int64_t  last_ns;    // and of its last
+    uint64_t first_row;
+    uint32_t rows;
+    uint32_t reserved;
+};
+
+int64_t dayOf(int64_t wall_ns);  // days since the epoch, UTC
+std::string partitionPath(const std::string& root, const std::string& symbol, int64_t day);
+
+} // namespace trade_store
+
+// Append side. Used from one thread (the journal writer); rows are buffered
+// until flush() writes them, so a trade is queryable once it is committed.
+class TradeStoreWriter {
+public:
+    explicit TradeStoreWriter(std::string root);
+    ~TradeStoreWriter();
+
+    void append(const TradeLog& trade);
+    // Writes everything appended so far; with sync, fdatasyncs it too.
+    // False on I/O error.
+    bool flush(bool sync);
+
+private:
+    struct Partition;
+
+    Partition* partitionFor(const std::string& symbol, int64_t day);
+
+    std::string root_;
+    std::unordered_map<std::string, std::unique_ptr<Partition>> partitions_;  // current day per symbol
+};
+
+struct TradeRow {
+    int64_t ts_ns;   // wall clock
+    Px      price;
+    Qty     qty;
+    OrdId   taker_id;
+    OrdId   maker_id;
+    bool    taker_is_buy;
+};
+
+struct TradeAggregate {
+    uint64_t trades{0};
+    uint64_t volume{0};
+    double   notional{0};
+    Px       first{0};
+    Px       high{0};
+    Px       low{0};
+    Px       last{0};
+
+    double vwap() const { return volume ? notional / static_cast<double>(volume) : 0.0; }
+};
+
+// Read-only, mmapped view of one symbol-day as it was when opened
+class TradePartition {
+public:
+    static std::optional<TradePartition> open(const std::string& root, const std::string& symbol, int64_t day);
+
+    size_t rows() const { return rows_; }
+
+    // Calls f(block, first, last) for the rows with from_ns <= ts < to_ns,
+    // block by block, in time order; rows are [first, last)
+    template<class F>
+    void forEachBlock(int64_t from_ns, int64_t to_ns, F&& f) const;
+
+    int64_t ts(const trade_store::IndexEntry& block, size_t row) const { return block.base_ns + ts_[row]; }
+    const uint32_t* tsDeltas() const { return ts_; }
+    const Px*       prices() const { return price_; }
+    const Qty*      quantities() const { return qty_; }
+    const OrdId*    takerIds() const { return taker_; }
+    const OrdId*    makerIds() const { return maker_; }
+    const uint8_t*  takerIsBuy() const { return side_; }
+
+private:
+    std::vector<std::shared_ptr<const void>> mappings_;
+    const trade_store::IndexEntry* index_{nullptr};
+    size_t blocks_{0};
+    size_t rows_{0};
+    const uint32_t* ts_{nullptr};
+    const Px*       price_{nullptr};
+    const Qty*      qty_{nullptr};
+    const OrdId*    taker_{nullptr};
+    const OrdId*    maker_{nullptr};
+    const uint8_t*  side_{nullptr};
+};
+
+// Queries over every day a time range touches
+class TradeHistory {
+public:
+    explicit TradeHistory(std::string root) : root_(std::move(root)) {}
+
+    // f(const TradeRow&) for trades with from_ns <= ts < to_ns, in time order
+    template<class F>
+    void scan(const std::string& symbol, int64_t from_ns, int64_t to_ns, F&& f) const;
+
+    std::vector<TradeRow> trades(const std::string& symbol, int64_t from_ns, int64_t to_ns) const;
+    TradeAggregate aggregate(const std::string& symbol, int64_t from_ns, int64_t to_ns) const;
+
+private:
+    template<class F>
+    void forEachPartition(const std::string& symbol, int64_t from_ns, int64_t to_ns, F&& f) const;
+
+    std::string root_;
+};
+
+template<class F>
+void TradePartition::forEachBlock(int64_t from_ns, int64_t to_ns, F&& f) const {
+    // Skip whole blocks by the index, then trim the edge blocks row by row
+    const auto* end = index_ + blocks_;
+    const auto* block = std::partition_point(index_, end, [from_ns](const trade_store::IndexEntry& e) {
+        return e.last_ns < from_ns;
+    });
+    for (; block != end && block->base_ns < to_ns; ++block) {
+        size_t begin = std::min<size_t>(block->first_row, rows_);
+        size_t end_row = std::min<size_t>(block->first_row + block->rows, rows_);
+        // Deltas rise within a block, so the edges are binary searches
+        auto lower = [&](int64_t t) -> size_t {
+            if (t <= block->base_ns) return begin;
+            if (t - block->base_ns > UINT32_MAX) return end_row;
+            return static_cast<size_t>(std::lower_bound(ts_ + begin, ts_ + end_row,
+                                                        static_cast<uint32_t>(t - block->base_ns)) - ts_);
+        };
+        size_t first = lower(from_ns);
+        size_t last = lower(to_ns);
+        if (first < last) f(*block, first, last);
+    }
+}
+
+template<class F>
+void TradeHistory::forEachPartition(const std::string& symbol, int64_t from_ns, int64_t to_ns, F&& f) const {
+    if (from_ns >= to_ns) return;
+    for (int64_t day = trade_store::dayOf(from_ns); day <= trade_store::dayOf(to_ns - 1); ++day) {
+        if (auto partition = TradePartition::open(root_, symbol, day)) f(*partition);
+    }
+}
+
+template<class F>
+void TradeHistory::scan(const std::string& symbol, int64_t from_ns, int64_t to_ns, F&& f) const {
+    forEachPartition(symbol, from_ns, to_ns, [&](const TradePartition& p) {
+        p.forEachBlock(from_ns, to_ns, [&](const trade_store::IndexEntry& block, size_t first, size_t last) {
+            for (size_t row = first; row < last; ++row) {
+                f(TradeRow{p.ts(block, row), p.prices()[row], p.quantities()[row],
+                           p.takerIds()[row], p.makerIds()[row], p.takerIsBuy()[row] != 0});
+            }
+        });
+    });
+}
+
+#endif
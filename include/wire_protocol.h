@@ -0,0 +1,142 @@
+#ifndef WIRE_PROTOCOL_H
+#define WIRE_PROTOCOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include "order.h"
+#include "request_api.h"
+#include "event_api.h"
+
+// Fixed-layout binary order entry. Every message starts with a Header whose
+// length covers the whole message, little-endian, no padding. Symbols are the
+// exchange's SymbolIds and order types are OrderKind values, so decoding is a
+// bounds check and a field read straight out of the receive buffer.
+namespace wire {
+
+enum class MsgType : uint8_t {
+    LOGON = 1,
+    NEW_ORDER = 2,
+    CANCEL = 3,
+    MODIFY = 4,
+    MASS_CANCEL = 5,
+
+    LOGON_ACK = 101,
+    EXEC_REPORT = 102,
+};
+
+inline constexpr uint8_t kVersion = 1;
+inline constexpr size_t kClientIdLength = 16;
+
+// NewOrder::flags
+inline constexpr uint8_t kHasPrice = 1 << 0;
+inline constexpr uint8_t kHasStopPrice = 1 << 1;
+inline constexpr uint8_t kHasDisplayQty = 1 << 2;
+
+// MassCancel::side
+inline constexpr uint8_t kBothSides = 2;
+
+#pragma pack(push, 1)
+struct Header {
+    uint32_t length;
+    MsgType  type;
+    uint8_t  version;
+    uint16_t reserved;
+};
+
+struct Logon {
+    Header hdr;
+    char   client_id[kClientIdLength];  // NUL-padded
+};
+
+struct NewOrder {
+    Header   hdr;
+    uint64_t request_id;
+    uint64_t order_id;
+    uint32_t symbol_id;
+    uint8_t  order_type;   // OrderKind
+    uint8_t  side;         // Side
+    uint8_t  tif;          // TimeInForce
+    uint8_t  flags;
+    double   price;
+    double   stop_price;
+    uint32_t quantity;
+    uint32_t display_quantity;
+    int64_t  expire_at_ns; // wall clock, GTD only
+};
+
+struct Cancel {
+    Header   hdr;
+    uint64_t request_id;
+    uint64_t order_id;
+    uint32_t symbol_id;
+};
+
+struct Modify {
+    Header   hdr;
+    uint64_t request_id;
+    uint64_t order_id;
+    uint32_t symbol_id;
+    double   price;
+    uint32_t quantity;
+};
+
+struct MassCancel {
+    Header   hdr;
+    uint64_t request_id;
+    uint32_t symbol_id;
+    uint8_t  side;         // Side, or kBothSides
+    uint8_t  own_orders;   // nonzero: only this session's client
+};
+
+struct LogonAck {
+    Header hdr;
+};
+
+// Followed by fill_count ExecFill records
+struct ExecReport {
+    Header   hdr;
+    uint64_t request_id;
+    uint8_t  status;       // RequestStatus
+    uint8_t  reason;       // RejectReason
+    uint16_t fill_count;
+    uint32_t filled_qty;
+    uint32_t remaining_qty;
+};
+
+struct ExecFill {
+    uint64_t maker_id;
+    double   price;
+    uint32_t qty;
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+// View of a complete message inside a receive buffer; nullptr when the
+// buffer holds less than T
+template<class T>
+inline const T* view(const char* data, size_t size) {
+    return size >= sizeof(T) ? reinterpret_cast<const T*>(data) : nullptr;
+}
+
+template<class T>
+inline Header header_for(MsgType type, size_t extra = 0) {
+    return Header{static_cast<uint32_t>(sizeof(T) + extra), type, kVersion, 0};
+}
+
+struct DecodedRequest {
+    SymbolId symbol;
+    TradingRequest request;  // symbol left empty; the exchange fills it in
+};
+
+// One complete request message on behalf of client; nullopt if it is
+// malformed or not a request
+std::optional<DecodedRequest> decode_request(const char* data, size_t length, const ClientId& client);
+
+// Appends one or more EXEC_REPORTs, at most max_fills fills each
+void encode_report(std::vector<char>& out, const RequestOutcome& outcome, size_t max_fills = UINT16_MAX);
+
+} // namespace wire
+
+#endif
@@ -0,0 +1,83 @@
+#include "admission.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+namespace {
+    constexpr int64_t kRecentStepNs = 1000000;
+}
+
+AdmissionControl::AdmissionControl(AdmissionConfig config)
+    : config_(config),
+      table_(config.max_clients,
+             [this](Slot& slot) {
+                 storeRate(slot, ClientRate{config_.client_rate, config_.client_burst});
+                 slot.explicit_rate.store(false, std::memory_order_relaxed);
+                 slot.tat_ns.store(0, std::memory_order_relaxed);
+                 slot.inflight.store(0, std::memory_order_relaxed);
+             },
+             [this](const Slot& slot) {
+                 return !slot.explicit_rate.load(std::memory_order_relaxed) &&
+                        slot.inflight.load(std::memory_order_relaxed) == 0 &&
+                        slot.tat_ns.load(std::memory_order_relaxed) <= recentNs_.load(std::memory_order_relaxed);
+             }) {}
+
+bool AdmissionControl::setClientRate(const ClientId& client, const ClientRate& rate) {
+    auto slot = table_.acquire(client);
+    if (!slot) return false;
+    storeRate(*slot, rate);
+    slot->explicit_rate.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool AdmissionControl::takeToken(const ClientId& client, int64_t now_ns) {
+    if (now_ns - recentNs_.load(std::memory_order_relaxed) > kRecentStepNs) {
+        recentNs_.store(now_ns, std::memory_order_relaxed);
+    }
+    auto slot = table_.acquire(client);
+    if (!slot) return false;
+    int64_t interval = slot->interval_ns.load(std::memory_order_relaxed);
+    if (interval == 0) return true;
+    if (interval < 0) return false;
+    int64_t tolerance = slot->tolerance_ns.load(std::memory_order_relaxed);
+
+    int64_t tat = slot->tat_ns.load(std::memory_order_relaxed);
+    while (true) {
+        int64_t next = std::max(tat, now_ns) + interval;
+        if (next - now_ns > tolerance + interval) return false;
+        if (slot->tat_ns.compare_exchange_weak(tat, next, std::memory_order_relaxed)) return true;
+    }
+}
+
+bool AdmissionControl::enter(const ClientId& client) {
+    auto slot = table_.acquire(client);
+    if (!slot) return false;
+    if (slot->inflight.fetch_add(1, std::memory_order_relaxed) >= config_.max_client_inflight) {
+        slot->inflight.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::leave(const ClientId& client) {
+    // Holds a slot while anything is in flight, so it is still there
+    if (auto slot = table_.find(client)) slot->inflight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int64_t AdmissionControl::inflight(const ClientId& client) {
+    auto slot = table_.find(client);
+    return slot ? slot->inflight.load(std::memory_order_relaxed) : 0;
+}
+
+void AdmissionControl::storeRate(Slot& slot, const ClientRate& rate) {
+    int64_t interval = 0;
+    if (!(rate.rate > 0)) {
+        interval = -1;
+    } else if (std::isfinite(rate.rate)) {
+        interval = std::max<int64_t>(1, std::llround(1e9 / rate.rate));
+    }
+    slot.interval_ns.store(interval, std::memory_order_relaxed);
+    slot.tolerance_ns.store(static_cast<int64_t>(interval * std::max(0.0, rate.burst - 1)), std::memory_order_relaxed);
+}
@@ -0,0 +1,62 @@
+#include "allocation.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Top order first: the front of the level, if it set the price
+    Qty take_top_order(const AllocationRules& rules, bool top_order, Qty amount, Qty* residual, Qty* out, size_t n) {
+        if (!top_order || !rules.top_order_priority || n == 0) return amount;
+        Qty take = std::min({residual[0], amount, rules.top_order_cap});
+        residual[0] -= take;
+        out[0] += take;
+        return amount - take;
+    }
+}
+
+Qty allocation::fifo(Qty* residual, Qty* out, size_t n, Qty amount) {
+    for (size_t i = 0; i < n && amount > 0; ++i) {
+        Qty take = std::min(residual[i], amount);
+        residual[i] -= take;
+        out[i] += take;
+        amount -= take;
+    }
+    return amount;
+}
+
+Qty allocation::pro_rata(Qty* residual, Qty* out, size_t n, Qty amount, Qty min_allocation) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; ++i) total += residual[i];
+    if (total == 0 || amount == 0) return amount;
+    if (amount >= total) return fifo(residual, out, n, amount);
+
+    // amount < total, so the ratio fits in 32 bits and every product in 64.
+    // The ratio is short by under 2^-32, so a share can come out one below
+    // floor(residual * amount / total); the remainder check restores it.
+    // The remainder is below 2 * total, so it is exact even if share * total wraps.
+    uint64_t ratio = (static_cast<uint64_t>(amount) << 32) / total;
+    uint64_t given = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t exact = static_cast<uint64_t>(residual[i]) * amount;
+        uint64_t share = (static_cast<uint64_t>(residual[i]) * ratio) >> 32;
+        share += (exact - share * total) >= total;
+        share = share >= min_allocation ? share : 0;
+        residual[i] -= static_cast<Qty>(share);
+        out[i] += static_cast<Qty>(share);
+        given += share;
+    }
+    return static_cast<Qty>(amount - given);
+}
+
+void ProRataAllocation::allocate(const AllocationRules& rules, bool top_order, Qty amount, Qty* residual, Qty* out, size_t n) {
+    amount = take_top_order(rules, top_order, amount, residual, out, n);
+    amount = allocation::pro_rata(residual, out, n, amount, rules.min_allocation);
+    allocation::fifo(residual, out, n, amount);
+}
+
+void HybridAllocation::allocate(const AllocationRules& rules, bool top_order, Qty amount, Qty* residual, Qty* out, size_t n) {
+    amount = take_top_order(rules, top_order, amount, residual, out, n);
+    auto fifo_part = static_cast<Qty>(std::floor(amount * std::clamp(rules.fifo_share, 0.0, 1.0)));
+    amount = amount - fifo_part + allocation::fifo(residual, out, n, fifo_part);
+    amount = allocation::pro_rata(residual, out, n, amount, rules.min_allocation);
+    allocation::fifo(residual, out, n, amount);
+}
@@ -0,0 +1,117 @@
+#include "clock.h"
+#include <ctime>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace {
+    bool detectInvariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_max(0x80000000, nullptr) >= 0x80000007 &&
+            __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+            return (edx & (1u << 8)) != 0;
+        }
+#endif
+        return false;
+    }
+
+    int64_t realtimeNanos() {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    int64_t steadyNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    constexpr int64_t kRecalibrateAfterNs = 1000000000LL;
+
+    // First pairing: the rate is re-estimated over the whole span since then
+    std::mutex calibrationMutex;
+    uint64_t anchorTicks = 0;
+    int64_t  anchorSteadyNs = 0;
+}
+
+bool Clock::useTsc_ = detectInvariantTsc();
+std::atomic<uint64_t> Clock::seq_{0};
+std::atomic<uint64_t> Clock::baseTicks_{0};
+std::atomic<int64_t>  Clock::baseWallNs_{0};
+std::atomic<double>   Clock::nsPerTick_{1.0};
+std::atomic<double>   Clock::durationNsPerTick_{1.0};
+
+namespace {
+    const bool startupCalibration = (Clock::calibrate(), true);
+}
+
+void Clock::calibrate() {
+    std::lock_guard<std::mutex> lock(calibrationMutex);
+
+    double ns_per_tick = 1.0;
+    if (useTsc_) {
+        if (anchorTicks == 0) {
+            // Startup: measure the rate over a short spin
+            anchorTicks = now().ticks;
+            anchorSteadyNs = steadyNanos();
+            while (steadyNanos() - anchorSteadyNs < 10000000LL) {}
+            uint64_t ticks = now().ticks;
+            int64_t steady = steadyNanos();
+            ns_per_tick = static_cast<double>(steady - anchorSteadyNs) / static_cast<double>(ticks - anchorTicks);
+            // Deadlines keep this rate for the life of the process
+            durationNsPerTick_.store(ns_per_tick, std::memory_order_relaxed);
+        } else {
+            uint64_t ticks = now().ticks;
+            int64_t steady = steadyNanos();
+            ns_per_tick = static_cast<double>(steady - anchorSteadyNs) / static_cast<double>(ticks - anchorTicks);
+        }
+    }
+
+    uint64_t ticks = now().ticks;
+    int64_t wall = realtimeNanos();
+
+    seq_.fetch_add(1, std::memory_order_acq_rel);
+    baseTicks_.store(ticks, std::memory_order_relaxed);
+    baseWallNs_.store(wall, std::memory_order_relaxed);
+    nsPerTick_.store(ns_per_tick, std::memory_order_relaxed);
+    seq_.fetch_add(1, std::memory_order_release);
+}
+
+Clock::Calibration Clock::current() {
+    Calibration cal;
+    uint64_t seq;
+    do {
+        seq = seq_.load(std::memory_order_acquire);
+        cal.base_ticks = baseTicks_.load(std::memory_order_relaxed);
+        cal.base_wall_ns = baseWallNs_.load(std::memory_order_relaxed);
+        cal.ns_per_tick = nsPerTick_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != seq_.load(std::memory_order_relaxed));
+    return cal;
+}
+
+int64_t Clock::toWallNanos(Timestamp ts) {
+    Calibration cal = current();
+    if (static_cast<double>(now().ticks - cal.base_ticks) * cal.ns_per_tick > kRecalibrateAfterNs) {
+        calibrate();
+        cal = current();
+    }
+    auto delta = static_cast<int64_t>(ts.ticks - cal.base_ticks);
+    return cal.base_wall_ns + static_cast<int64_t>(static_cast<double>(delta) * cal.ns_per_tick);
+}
+
+Timestamp Clock::fromWallNanos(int64_t wall_ns) {
+    Calibration cal = current();
+    auto delta = static_cast<int64_t>(static_cast<double>(wall_ns - cal.base_wall_ns) / cal.ns_per_tick);
+    return Timestamp{cal.base_ticks + static_cast<uint64_t>(delta)};
+}
+
+uint64_t Clock::toNanos(Timestamp ts) {
+    return static_cast<uint64_t>(static_cast<double>(ts.ticks) * durationNsPerTick_.load(std::memory_order_relaxed));
+}
+
+uint64_t Clock::ticksFor(std::chrono::nanoseconds d) {
+    return static_cast<uint64_t>(static_cast<double>(d.count()) / durationNsPerTick_.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,175 @@
+#include "drop_copy.h"
+#include <bit>
+#include <functional>
+#include "clock.h"
+
+ExecutionStream::ExecutionStream(ClientId client, const DropCopyConfig& config)
+    : client_(std::move(client)),
+      policy_(config.policy),
+      maxConflated_(config.max_conflated_orders),
+      slots_(std::make_unique<Slot[]>(std::bit_ceil(std::max<size_t>(2, config.ring_capacity)))),
+      mask_(std::bit_ceil(std::max<size_t>(2, config.ring_capacity)) - 1) {
+    for (size_t i = 0; i <= mask_; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+void ExecutionStream::push(const ExecutionReport& report) {
+    uint32_t state = state_.load(std::memory_order_acquire);
+    if (state != ACTIVE) {
+        if (state == DISCONNECTED) dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!conflating_.load(std::memory_order_acquire) && tryPush(report)) return;
+
+    if (policy_ == SlowConsumerPolicy::DISCONNECT) {
+        // What is already queued stays readable; the client reconciles after it
+        state_.store(DISCONNECTED, std::memory_order_release);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    conflate(report);
+}
+
+bool ExecutionStream::tryPush(const ExecutionReport& report) {
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[pos & mask_];
+        int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+    slot->report = report;
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool ExecutionStream::tryPop(ExecutionReport& out) {
+    uint64_t pos = tail_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[pos & mask_];
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1) return false;
+    out = slot.report;
+    slot.seq.store(pos + mask_ + 1, std::memory_order_release);
+    tail_.store(pos + 1, std::memory_order_relaxed);
+    out.ts_ns = Clock::toWallNanos(Timestamp{static_cast<uint64_t>(out.ts_ns)});
+    return true;
+}
+
+void ExecutionStream::conflate(const ExecutionReport& report) {
+    std::lock_guard<std::mutex> lock(overflowMutex_);
+    conflating_.store(true, std::memory_order_release);
+    auto it = overflowIndex_.find(report.order_id);
+    if (it != overflowIndex_.end()) {
+        ExecutionReport& merged = overflow_[it->second];
+        double notional = merged.price * merged.qty + report.price * report.qty;
+        merged.qty += report.qty;
+        merged.price = merged.qty ? notional / merged.qty : report.price;
+        merged.fills += report.fills;
+        merged.match_seq = report.match_seq;
+        merged.ts_ns = report.ts_ns;
+        conflated_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (overflow_.size() >= maxConflated_) {
+        state_.store(DISCONNECTED, std::memory_order_release);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    overflowIndex_.emplace(report.order_id, overflow_.size());
+    overflow_.push_back(report);
+}
+
+size_t ExecutionStream::drainConflated(std::vector<ExecutionReport>& out) {
+    if (!conflating_.load(std::memory_order_acquire)) return 0;
+    out.clear();
+    delivered_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        out.swap(overflow_);
+        overflowIndex_.clear();
+        conflating_.store(false, std::memory_order_release);
+    }
+    for (auto& report : out) report.ts_ns = Clock::toWallNanos(Timestamp{static_cast<uint64_t>(report.ts_ns)});
+    return out.size();
+}
+
+void ExecutionStream::reconnect() {
+    ExecutionReport discarded;
+    uint64_t stale = 0;
+    while (tryPop(discarded)) ++stale;
+    {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        stale += overflow_.size();
+        overflow_.clear();
+        overflowIndex_.clear();
+        conflating_.store(false, std::memory_order_release);
+    }
+    stale += delivering_.size() - delivered_;
+    delivering_.clear();
+    delivered_ = 0;
+    dropped_.fetch_add(stale, std::memory_order_relaxed);
+    state_.store(ACTIVE, std::memory_order_release);
+}
+
+DropCopy::DropCopy(DropCopyConfig config)
+    : config_(config),
+      table_(std::make_unique<std::atomic<ExecutionStream*>[]>(std::bit_ceil(2 * std::max<size_t>(1, config.max_clients)))),
+      mask_(std::bit_ceil(2 * std::max<size_t>(1, config.max_clients)) - 1) {}
+
+ExecutionStream* DropCopy::subscribe(const ClientId& client) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ExecutionStream* stream = find(client)) {
+        if (stream->state_.load(std::memory_order_acquire) == ExecutionStream::CLOSED) {
+            subscribed_.fetch_add(1, std::memory_order_relaxed);
+        }
+        stream->reconnect();
+        return stream;
+    }
+    if (streams_.size() >= config_.max_clients) return nullptr;
+
+    streams_.push_back(std::make_unique<ExecutionStream>(client, config_));
+    ExecutionStream* stream = streams_.back().get();
+    size_t i = std::hash<ClientId>{}(client) & mask_;
+    while (table_[i].load(std::memory_order_relaxed)) i = (i + 1) & mask_;
+    table_[i].store(stream, std::memory_order_release);
+    subscribed_.fetch_add(1, std::memory_order_relaxed);
+    return stream;
+}
+
+void DropCopy::unsubscribe(const ClientId& client) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ExecutionStream* stream = find(client);
+    if (!stream) return;
+    if (stream->state_.exchange(ExecutionStream::CLOSED, std::memory_order_acq_rel) != ExecutionStream::CLOSED) {
+        subscribed_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void DropCopy::onTrade(SymbolId symbol, const TradeLog& trade) {
+    if (empty()) return;
+    const Fill& fill = trade.fill;
+    // Raw ticks for now; the consumer converts them when it polls, so the
+    // strand never waits on the clock calibration
+    auto ticks = static_cast<int64_t>(fill.ts.ticks);
+    Side takerSide = fill.taker_is_buy ? Side::BUY : Side::SELL;
+    Side makerSide = fill.taker_is_buy ? Side::SELL : Side::BUY;
+    if (ExecutionStream* taker = find(trade.taker_client)) {
+        taker->push(ExecutionReport{symbol, fill.taker_id, takerSide, false, 1, fill.price, fill.qty, fill.match_seq, ticks});
+    }
+    if (ExecutionStream* maker = find(trade.maker_client)) {
+        maker->push(ExecutionReport{symbol, fill.maker_id, makerSide, true, 1, fill.price, fill.qty, fill.match_seq, ticks});
+    }
+}
+
+ExecutionStream* DropCopy::find(const ClientId& client) const {
+    // Linear probing; slots are only ever filled, so a null ends the search
+    for (size_t i = std::hash<ClientId>{}(client) & mask_;; i = (i + 1) & mask_) {
+        ExecutionStream* stream = table_[i].load(std::memory_order_acquire);
+        if (!stream) return nullptr;
+        if (stream->client() == client) return stream;
+    }
+}
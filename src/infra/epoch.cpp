@@ -0,0 +1,19 @@
+#include "epoch.h"
+#include <thread>
+
+void EpochDomain::synchronize() {
+    std::lock_guard<std::mutex> lock(writer_);
+    // A reader may have read the epoch before a flip but counted itself after
+    // it, landing in the side we are not draining; the second flip drains it
+    flipAndDrain();
+    flipAndDrain();
+}
+
+void EpochDomain::flipAndDrain() {
+    uint64_t old = epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+    for (auto& stripe : stripes_) {
+        while (stripe.active[old].load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
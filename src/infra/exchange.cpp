@@ -1,14 +1,29 @@
 #include "exchange.h"
 #include <iostream>
 
-Exchange::AssetContext::AssetContext(const std::string& symbol, ThreadPool& threadPool) 
-    : symbol_(symbol),
-      strand_(std::make_unique<Strand>(threadPool)),
-      orderBook_(std::make_unique<OrderBook>(symbol)) {}
-
-Exchange::Exchange(const std::vector<std::string>& symbols, size_t numWorkerThreads) 
-    : threadPool_(numWorkerThreads),
-      logger_(std::make_unique<Logger>("logs_internal/")),
+thread_local Exchange::AssetContext* Exchange::matching_ = nullptr;
+
+Exchange::AssetContext::AssetContext(const std::string& symbol, SymbolId id, Shard& shard, const StatsConfig& stats) 
+    : strand_(std::make_unique<Strand>(shard.pool())),
+      symbol_(symbol),
+      id_(id),
+      shard_(&shard),
+      tradeStats_(stats) {
+    // Built on the shard thread so the book's own pages are local to it too
+    shard.run([this, &shard] {
+        orderBook_ = std::make_unique<OrderBook>(symbol_, shard.memory());
+    });
+}
+
+Exchange::Exchange(const std::vector<std::string>& symbols, size_t numWorkerThreads, JournalConfig journal,
+                   ShardConfig shardConfig, AdmissionConfig admission, StatsConfig stats,
+                   DropCopyConfig dropCopy, TraceConfig trace, RiskConfig risk) 
+    : logger_(std::make_unique<Logger>(journal.directory, journal)),
+      riskManager_(risk),
+      admission_(admission),
+      dropCopy_(dropCopy),
+      tracer_(std::move(trace)),
+
       matchingEngine_(
           // OrderLogger callback
           [this](const OrderLog& orderLog) { 
@@ -17,12 +32,32 @@ Exchange::Exchange(const std::vector<std::string>& symbols, size_t numWorkerThre
           // TradeLogger callback  
           [this](const TradeLog& tradeLog) { 
               logger_->logTradeEvent(tradeLog); 
+              // Every fill comes out of apply(), which already holds the
+              // asset; the listing may no longer have it while a delisted
+              // book drains
+              if (matching_) onTrade(*matching_, tradeLog);
+          },
+          &riskManager_,
+          // OrderBatchLogger callback
+          [this](std::vector<OrderLog>&& orderLogs) {
+              logger_->logOrderEvents(std::move(orderLogs));
           }
-      ) {
+      ),
+      shardConfig_(shardConfig),
+      statsConfig_(std::move(stats)),
+      lastSample_(std::chrono::steady_clock::now()) {
     
-    // create AssetContexts for all specified symbols
+    for (size_t i = 0; i < std::max<size_t>(1, numWorkerThreads); ++i) {
+        shards_.push_back(std::make_unique<Shard>(i, shardConfig));
+    }
+
+    currentListing_ = std::make_unique<const Listing>();
+    listing_.store(currentListing_.get(), std::memory_order_release);
     for (const auto& symbol : symbols) {
-        assets_[symbol] = std::make_unique<AssetContext>(symbol, threadPool_);
+        addSymbol(symbol);
+    }
+    if (shards_.size() > 1 && shardConfig.rebalance_interval.count() > 0) {
+        rebalanceThread_ = std::thread(&Exchange::rebalanceLoop, this);
     }
 }
 
@@ -30,35 +65,773 @@ Exchange::~Exchange() {
     shutdown();
 }
 
-RequestOutcome Exchange::processRequest(TradingRequest&& req) {
-    auto requestId = std::visit([](const auto& r) { return r.request_id; }, req);
+std::future<RequestOutcome> Exchange::submitRequest(TradingRequest&& req) {
+    auto outcome = std::make_shared<std::promise<RequestOutcome>>();
+    auto result = outcome->get_future();
+    submitRequest(std::move(req), [outcome](RequestOutcome&& processed) {
+        outcome->set_value(std::move(processed));
+    });
+    return result;
+}
+
+void Exchange::submitRequest(TradingRequest&& req, Completion done) {
     auto symbol = std::visit([](const auto& r) { return r.symbol; }, req);
-    AssetContext& ac = getAssetContext(symbol)->get();
-    RequestOutcome outcome;
+    std::optional<std::chrono::steady_clock::time_point> blockedUntil;
+    while (true) {
+        {
+            EpochDomain::Reader reader(epoch_);
+            AssetContext* ac = findAsset(symbol);
+            if (!ac) {
+                done(RequestOutcome{
+                    .request_id = std::visit([](const auto& r) { return r.request_id; }, req),
+                    .status = RequestStatus::REJECTED,
+                    .reason = RejectReason::UNKNOWN_SYMBOL,
+                    .message = "Unknown symbol: " + symbol
+                });
+                return;
+            }
+            if (!mustWait(*ac, req, blockedUntil)) {
+                dispatch(*ac, std::move(req), std::move(done));
+                return;
+            }
+        }
+        // Outside the epoch section, so a delisting never waits on us
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+void Exchange::submitRequest(SymbolId symbolId, TradingRequest&& req, Completion done) {
+    std::optional<std::chrono::steady_clock::time_point> blockedUntil;
+    while (true) {
+        {
+            EpochDomain::Reader reader(epoch_);
+            AssetContext* ac = findAsset(symbolId);
+            if (!ac) {
+                done(RequestOutcome{
+                    .request_id = std::visit([](const auto& r) { return r.request_id; }, req),
+                    .status = RequestStatus::REJECTED,
+                    .reason = RejectReason::UNKNOWN_SYMBOL,
+                    .message = "Unknown symbol id: " + std::to_string(symbolId)
+                });
+                return;
+            }
+            if (!mustWait(*ac, req, blockedUntil)) {
+                std::visit([ac](auto& r) { r.symbol = ac->symbol_; }, req);
+                dispatch(*ac, std::move(req), std::move(done));
+                return;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+void Exchange::dispatch(AssetContext& ac, TradingRequest&& req, Completion done) {
+    if (standby_.load(std::memory_order_acquire)) {
+        done(RequestOutcome{
+            .request_id = std::visit([](const auto& r) { return r.request_id; }, req),
+            .status = RequestStatus::REJECTED,
+            .reason = RejectReason::STANDBY,
+            .message = "Backup not promoted"
+        });
+        return;
+    }
 
+    // The one clock read for this request; every event it produces reuses it
+    Timestamp ingress = Clock::now();
+    ac.requests_.fetch_add(1, std::memory_order_relaxed);
+
+    bool cancel = isCancel(req);
+    const ClientId* client = std::visit(Overloaded{
+        [](const NewOrderRequest& r) -> const ClientId* { return &r.params.client; },
+        [](const ModifyOrderRequest& r) -> const ClientId* { return r.client_id ? &*r.client_id : nullptr; },
+        [](const MassCancelRequest& r) -> const ClientId* { return r.client_id ? &*r.client_id : nullptr; },
+        [](const auto&) -> const ClientId* { return nullptr; }
+    }, req);
+    if (const char* refused = admit(ac, client, cancel, ingress)) {
+        done(RequestOutcome{
+            .request_id = std::visit([](const auto& r) { return r.request_id; }, req),
+            .status = RequestStatus::REJECTED,
+            .reason = RejectReason::THROTTLED,
+            .message = refused
+        });
+        return;
+    }
+    if (client && !cancel) {
+        done = [this, owner = *client, done = std::move(done)](RequestOutcome&& outcome) {
+            admission_.leave(owner);
+            done(std::move(outcome));
+        };
+    }
+
+    bool sampled = false;
+    if (tracer_.enabled()) {
+        sampled = tracer_.sample();
+        done = [this, id = ac.id_, ingress, sampled, done = std::move(done)](RequestOutcome&& outcome) {
+            Timestamp now = Clock::now();
+            if (sampled) tracer_.record(TraceSpan{"request", ingress, now, outcome.request_id, id});
+            tracer_.onLatency(ingress, now);
+            done(std::move(outcome));
+        };
+    }
+
+    // The outcome is filled in on the strand
     ac.strand_->post(
-        [this, &ac, &outcome, req = std::move(req)]() mutable {
-            outcome = matchingEngine_.process_request(*ac.orderBook_, std::move(req));
-            onRequestProcessed(outcome);
+        [this, &ac, ingress, sampled, done = std::move(done), req = std::move(req)]() mutable {
+            tracing::Context trace{&tracer_, std::visit([](const auto& r) { return r.request_id; }, req), ac.id_};
+            Timestamp started{};
+            if (sampled) {
+                // Split the wait at the point the strand handed the task to the pool
+                started = Clock::now();
+                Timestamp scheduled = std::max(ingress, ac.strand_->scheduled());
+                tracer_.record(TraceSpan{"strand_queue", ingress, scheduled, trace.request_id, trace.symbol});
+                tracer_.record(TraceSpan{"pool_wait", scheduled, started, trace.request_id, trace.symbol});
+                tracing::current = &trace;
+            }
+            if (replicator_) {
+                // Encoded now: the engine consumes the request
+                ac.replicationBody_.clear();
+                replication::encode_request(ac.replicationBody_, req);
+                ac.orderBook_->risk_verdict_.reset();
+            }
+            RequestOutcome processed;
+            try {
+                processed = apply(ac, std::move(req), ingress);
+            } catch (...) {
+                // The strand would swallow this and done would never run,
+                // leaking the client's in-flight slot and hanging the caller
+                matching_ = nullptr;
+                tracing::current = nullptr;
+                std::string what = "unknown exception";
+                try {
+                    throw;
+                } catch (const std::exception& e) {
+                    what = e.what();
+                } catch (...) {
+                }
+                std::cerr << "Error: request " << trace.request_id << " on " << ac.symbol_ << " failed: " << what << std::endl;
+                done(RequestOutcome{
+                    .request_id = trace.request_id,
+                    .status = RequestStatus::REJECTED,
+                    .reason = RejectReason::INTERNAL_ERROR,
+                    .message = "Internal error: " + what
+                });
+                return;
+            }
+            uint64_t replicaSeq = replicate(ac, replication::FrameType::REQUEST, ingress);
+            uint64_t journalSeq = onRequestProcessed(processed);
+            if (sampled) {
+                tracing::current = nullptr;
+                tracer_.record(TraceSpan{"strand_task", started, Clock::now(), trace.request_id, trace.symbol});
+                // Logger queue, write and sync, ending on the journal thread
+                logger_->whenCommitted(journalSeq, [this, trace, enqueued = Clock::now()]() {
+                    tracer_.record(TraceSpan{"journal_commit", enqueued, Clock::now(), trace.request_id, trace.symbol});
+                });
+            }
+
+            bool waitForReplica = replicaSeq && replicator_->mode() == ReplicationMode::SYNC;
+            bool waitForJournal = logger_->durability() == Durability::SYNC_BEFORE_ACK;
+            if (!waitForReplica && !waitForJournal) {
+                done(std::move(processed));
+                return;
+            }
+            std::function<void()> ack = [done = std::move(done), processed = std::move(processed)]() mutable {
+                done(std::move(processed));
+            };
+            if (waitForReplica) {
+                // Acked from the replicator's ack thread once the backup has it
+                ack = [this, replicaSeq, ack = std::move(ack)]() mutable {
+                    replicator_->whenAcked(replicaSeq, std::move(ack));
+                };
+            }
+            if (waitForJournal) {
+                // Acked from the journal thread once the watermark passes it
+                logger_->whenCommitted(journalSeq, std::move(ack));
+            } else {
+                ack();
+            }
         }
     );
-    return outcome;
 }
 
-std::optional<Exchange::AssetRef> Exchange::getAssetContext(std::string_view symbol) {
-    auto it = assets_.find(std::string(symbol));
-    if (it == assets_.end()) return std::nullopt;
-    return std::ref(*it->second);
+RequestOutcome Exchange::apply(AssetContext& ac, TradingRequest&& req, Timestamp ingress) {
+    {
+        tracing::Span span("expire_orders");
+        matchingEngine_.expire_orders(*ac.orderBook_, ingress);
+    }
+    RequestOutcome processed;
+    {
+        tracing::Span span("process_request");
+        PerfCounters* perf = ac.shard_->perf();
+        PerfCounters::Reading before;
+        size_t type = req.index();
+        bool counting = perf && perf->read(before);
+        matching_ = &ac;
+        processed = matchingEngine_.process_request(*ac.orderBook_, std::move(req), ingress);
+        matching_ = nullptr;
+        if (counting) perf->record(type, before);
+    }
+    if (marketData_.onBook) {
+        tracing::Span span("market_data");
+        marketData_.onBook(ac.id_, matchingEngine_.snapshot_l2(*ac.orderBook_, marketData_.depth));
+    }
+    if (size_t interval = logger_->checksumInterval(); interval && ++ac.sinceChecksum_ >= interval) {
+        ac.sinceChecksum_ = 0;
+        logger_->logChecksum(matchingEngine_.checksum_log(*ac.orderBook_, ingress));
+    }
+    return processed;
+}
+
+void Exchange::onTrade(AssetContext& ac, const TradeLog& trade) {
+    ac.tradeStats_.onFill(trade.fill);
+    dropCopy_.onTrade(ac.id_, trade);
+    if (marketData_.onTrade) {
+        marketData_.onTrade(ac.id_, trade.fill);
+    }
+}
+
+bool Exchange::isCancel(const TradingRequest& req) {
+    return std::holds_alternative<CancelOrderRequest>(req) || std::holds_alternative<MassCancelRequest>(req);
+}
+
+size_t Exchange::queueLimit(bool cancel) const {
+    // Cancels have headroom on the queue, so they still get through while
+    // new orders are being shed
+    const AdmissionConfig& config = admission_.config();
+    return config.max_symbol_queue + (cancel ? config.cancel_headroom : 0);
+}
+
+bool Exchange::mustWait(const AssetContext& ac, const TradingRequest& req,
+                        std::optional<std::chrono::steady_clock::time_point>& blockedUntil) {
+    const AdmissionConfig& config = admission_.config();
+    if (config.policy != OverloadPolicy::BLOCK || standby_.load(std::memory_order_acquire)) return false;
+    if (ac.strand_->pending() < queueLimit(isCancel(req))) return false;
+    auto now = std::chrono::steady_clock::now();
+    if (!blockedUntil) blockedUntil = now + config.max_block;
+    // Once the time is up, admit sheds it as THROTTLED
+    return now < *blockedUntil;
+}
+
+const char* Exchange::admit(AssetContext& ac, const ClientId* client, bool cancel, Timestamp ingress) {
+    // Blocking submitters have already waited for room, outside the epoch
+    if (ac.strand_->pending() >= queueLimit(cancel)) return "Symbol queue full";
+    // Cancels skip the client checks
+    if (!client || cancel) return nullptr;
+    if (!admission_.takeToken(*client, static_cast<int64_t>(Clock::toNanos(ingress)))) return "Client rate limit";
+    if (!admission_.enter(*client)) return "Too many requests in flight";
+    return nullptr;
+}
+
+RequestOutcome Exchange::processRequest(TradingRequest&& req) {
+    return submitRequest(std::move(req)).get();
+}
+
+std::vector<RequestOutcome> Exchange::cancelAllForClient(const ClientId& client) {
+    std::vector<Symb> symbols;
+    {
+        EpochDomain::Reader reader(epoch_);
+        for (const auto& [symbol, ac] : listing_.load(std::memory_order_acquire)->bySymbol) {
+            symbols.push_back(symbol);
+        }
+    }
+    std::vector<RequestOutcome> outcomes;
+    for (auto& symbol : symbols) {
+        outcomes.push_back(processRequest(MassCancelRequest(std::move(symbol), client)));
+    }
+    return outcomes;
+}
+
+void Exchange::cancelAllForClient(const ClientId& client, const Completion& done) {
+    std::vector<SymbolId> ids;
+    {
+        EpochDomain::Reader reader(epoch_);
+        for (const auto& [symbol, ac] : listing_.load(std::memory_order_acquire)->bySymbol) {
+            ids.push_back(ac->id_);
+        }
+    }
+    for (SymbolId id : ids) {
+        submitRequest(id, MassCancelRequest(Symb{}, client), done);
+    }
+}
+
+std::optional<L2Snapshot> Exchange::getL2Snapshot(const Symb& symbol, size_t depth) {
+    std::future<L2Snapshot> result;
+    {
+        EpochDomain::Reader reader(epoch_);
+        AssetContext* ac = findAsset(symbol);
+        if (!ac) return std::nullopt;
+
+        // Read the book on its own strand so the snapshot is consistent
+        auto snapshot = std::make_shared<std::promise<L2Snapshot>>();
+        result = snapshot->get_future();
+        ac->strand_->post([this, ac, snapshot, depth]() {
+            snapshot->set_value(matchingEngine_.snapshot_l2(*ac->orderBook_, depth));
+        });
+    }
+    return result.get();
+}
+
+bool Exchange::setAllocationRules(const Symb& symbol, const AllocationRules& allocation) {
+    std::future<void> applied;
+    {
+        EpochDomain::Reader reader(epoch_);
+        AssetContext* ac = findAsset(symbol);
+        if (!ac) return false;
+
+        auto done = std::make_shared<std::promise<void>>();
+        applied = done->get_future();
+        ac->strand_->post([this, ac, done, allocation]() {
+            ac->orderBook_->allocation_ = allocation;
+            if (replicator_) {
+                ac->replicationBody_.clear();
+                replication::encode_allocation(ac->replicationBody_, allocation);
+                replicate(*ac, replication::FrameType::ALLOCATION, ac->orderBook_->now_);
+            }
+            done->set_value();
+        });
+    }
+    applied.get();
+    return true;
+}
+
+std::optional<TradeSummary> Exchange::tradeSummary(std::string_view symbol) {
+    EpochDomain::Reader reader(epoch_);
+    AssetContext* ac = findAsset(symbol);
+    if (!ac) return std::nullopt;
+    return ac->tradeStats_.summary();
+}
+
+std::vector<OhlcvBar> Exchange::bars(std::string_view symbol, std::chrono::milliseconds interval, size_t count) {
+    EpochDomain::Reader reader(epoch_);
+    AssetContext* ac = findAsset(symbol);
+    if (!ac) return {};
+    return ac->tradeStats_.bars(interval, count);
+}
+
+ExecutionStream* Exchange::subscribeExecutions(const ClientId& client) {
+    return dropCopy_.subscribe(client);
+}
+
+void Exchange::unsubscribeExecutions(const ClientId& client) {
+    dropCopy_.unsubscribe(client);
+}
+
+TradeHistory Exchange::tradeHistory() const {
+    return TradeHistory(logger_->directory() + "trades");
+}
+
+void Exchange::replicateTo(std::unique_ptr<ReplicationTransport> transport, ReplicationConfig config) {
+    std::lock_guard<std::mutex> lock(listingMutex_);
+    replicator_ = std::make_unique<Replicator>(std::move(transport), config);
+    // Existing listings first, in id order, so the backup hands out the same
+    // ids. Delisted ids leave no trace to replay, so call this before any
+    // removeSymbol as well.
+    for (auto& ac : assets_) {
+        if (!ac) continue;
+        ac->replicationBody_.clear();
+        replication::encode_listing(ac->replicationBody_, ac->symbol_, ac->orderBook_->allocation_,
+                                    ac->orderBook_->session_close_);
+        replicate(*ac, replication::FrameType::LIST, Clock::now());
+    }
+}
+
+void Exchange::followPrimary(std::unique_ptr<ReplicationTransport> transport) {
+    standby_.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(listingMutex_);
+        for (auto& ac : assets_) {
+            if (!ac) continue;
+            AssetContext* context = ac.get();
+            context->strand_->post([context]() { context->orderBook_->replaying_ = true; });
+        }
+    }
+    replica_ = std::make_unique<ReplicaReceiver>(std::move(transport), [this](replication::Frame&& frame) {
+        applyReplicated(std::move(frame));
+    });
+}
+
+bool Exchange::promote() {
+    if (!replica_) return true;
+    replica_->stop();
+
+    // The books are live already; only the frames still queued on the
+    // strands remain, and each strand finishes those before this task
+    std::vector<std::future<void>> drained;
+    {
+        std::lock_guard<std::mutex> lock(listingMutex_);
+        for (auto& ac : assets_) {
+            if (!ac) continue;
+            AssetContext* context = ac.get();
+            auto done = std::make_shared<std::promise<void>>();
+            drained.push_back(done->get_future());
+            context->strand_->post([context, done]() {
+                context->orderBook_->replaying_ = false;
+                done->set_value();
+            });
+        }
+    }
+    for (auto& f : drained) f.wait();
+    standby_.store(false, std::memory_order_release);
+    return !replica_->broken() && divergences_.load(std::memory_order_acquire) == 0;
+}
+
+void Exchange::writeTrace(std::ostream& out) const {
+    tracer_.write(out);
+}
+
+std::string Exchange::dumpTrace() {
+    return tracer_.dump();
+}
+
+uint64_t Exchange::replicate(AssetContext& ac, replication::FrameType type, Timestamp ingress) {
+    if (!replicator_) return 0;
+    tracing::Span span("replicate");
+    const OrderBook& book = *ac.orderBook_;
+    if (type == replication::FrameType::REQUEST) replication::encode_expired(ac.replicationBody_, book.expired_);
+    return replicator_->append(replication::FrameMeta{
+        .type = type,
+        .symbol_id = ac.id_,
+        .ingress = ingress,
+        .checksum = book.checksum_,
+        .risk = type == replication::FrameType::REQUEST ? book.risk_verdict_ : std::nullopt
+    }, ac.replicationBody_);
+}
+
+void Exchange::applyReplicated(replication::Frame&& frame) {
+    using replication::FrameType;
+    // Listing changes are applied here, on the receiving thread, so they
+    // stay ordered against the frames that follow
+    switch (frame.type) {
+        case FrameType::LIST: {
+            {
+                std::lock_guard<std::mutex> lock(listingMutex_);
+                sessionClose_ = frame.session_close;
+            }
+            SymbolId id = addSymbol(frame.symbol, frame.allocation);
+            if (id != frame.symbol_id) {
+                divergences_.fetch_add(1, std::memory_order_relaxed);
+                std::cerr << "Error: replica listed " << frame.symbol << " as " << id
+                          << ", primary as " << frame.symbol_id << std::endl;
+            }
+            return;
+        }
+        case FrameType::DELIST: {
+            Symb symbol;
+            {
+                EpochDomain::Reader reader(epoch_);
+                if (AssetContext* ac = findAsset(frame.symbol_id)) symbol = ac->symbol_;
+            }
+            if (!symbol.empty()) removeSymbol(symbol);
+            return;
+        }
+        case FrameType::SESSION_CLOSE: {
+            std::lock_guard<std::mutex> lock(listingMutex_);
+            sessionClose_ = frame.session_close;
+            break;
+        }
+        default:
+            break;
+    }
+
+    EpochDomain::Reader reader(epoch_);
+    AssetContext* ac = findAsset(frame.symbol_id);
+    if (!ac) {
+        divergences_.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Error: replicated frame " << frame.seq << " for unknown symbol id " << frame.symbol_id << std::endl;
+        return;
+    }
+    if (frame.request) ac->requests_.fetch_add(1, std::memory_order_relaxed);
+    ac->strand_->post([this, ac, frame = std::move(frame)]() mutable {
+        OrderBook& book = *ac->orderBook_;
+        if (frame.request) {
+            std::visit([ac](auto& r) { r.symbol = ac->symbol_; }, *frame.request);
+            book.risk_verdict_.reset();
+            if (frame.risk) book.risk_verdict_ = RiskDecision{frame.risk->accepted, frame.breach};
+            book.expired_ = std::move(frame.expired);
+            onRequestProcessed(apply(*ac, std::move(*frame.request), frame.ingress));
+        } else if (frame.type == replication::FrameType::SESSION_CLOSE) {
+            book.session_close_ = frame.session_close;
+        } else if (frame.type == replication::FrameType::ALLOCATION) {
+            book.allocation_ = frame.allocation;
+        }
+        if (book.checksum_ != frame.checksum && divergences_.fetch_add(1, std::memory_order_relaxed) == 0) {
+            std::cerr << "Error: replica of " << ac->symbol_ << " diverged from the primary at stream sequence "
+                      << frame.seq << std::endl;
+        }
+    });
+}
+
+void Exchange::setSessionClose(Timestamp close) {
+    std::lock_guard<std::mutex> lock(listingMutex_);
+    sessionClose_ = close;
+    for (auto& ac : assets_) {
+        if (!ac) continue;
+        AssetContext* context = ac.get();
+        context->strand_->post([this, context, close]() {
+            context->orderBook_->session_close_ = close;
+            if (replicator_) {
+                context->replicationBody_.clear();
+                replication::encode_session_close(context->replicationBody_, close);
+                replicate(*context, replication::FrameType::SESSION_CLOSE, context->orderBook_->now_);
+            }
+        });
+    }
+}
+
+bool Exchange::setRiskLimits(const ClientId& client, const RiskLimits& limits) {
+    return riskManager_.setLimits(client, limits);
+}
+
+bool Exchange::attachClient(const ClientId& client) {
+    if (!riskManager_.pin(client)) return false;
+    if (!admission_.pin(client)) {
+        riskManager_.unpin(client);
+        return false;
+    }
+    return true;
+}
+
+void Exchange::detachClient(const ClientId& client) {
+    admission_.unpin(client);
+    riskManager_.unpin(client);
+}
+
+bool Exchange::setClientRate(const ClientId& client, const ClientRate& rate) {
+    return admission_.setClientRate(client, rate);
+}
+
+void Exchange::setMarketDataSink(MarketDataSink sink) {
+    marketData_ = std::move(sink);
+}
+
+std::optional<SymbolId> Exchange::symbolId(std::string_view symbol) {
+    EpochDomain::Reader reader(epoch_);
+    AssetContext* ac = findAsset(symbol);
+    if (!ac) return std::nullopt;
+    return ac->id_;
+}
+
+SymbolId Exchange::addSymbol(const Symb& symbol, const AllocationRules& allocation) {
+    std::lock_guard<std::mutex> lock(listingMutex_);
+    if (auto it = currentListing_->bySymbol.find(symbol); it != currentListing_->bySymbol.end()) {
+        return it->second->id_;
+    }
+    auto id = static_cast<SymbolId>(assets_.size());
+    auto ac = std::make_unique<AssetContext>(symbol, id, *shards_[id % shards_.size()], statsConfig_);
+    // Not yet reachable by any strand task, so set directly
+    ac->orderBook_->session_close_ = sessionClose_;
+    ac->orderBook_->allocation_ = allocation;
+    ac->orderBook_->replaying_ = standby_.load(std::memory_order_acquire);
+    if (replicator_) {
+        ac->replicationBody_.clear();
+        replication::encode_listing(ac->replicationBody_, symbol, allocation, sessionClose_);
+        replicate(*ac, replication::FrameType::LIST, Clock::now());
+    }
+
+    auto next = std::make_unique<Listing>(*currentListing_);
+    next->bySymbol.emplace(symbol, ac.get());
+    next->byId.push_back(ac.get());
+    assets_.push_back(std::move(ac));
+    publish(std::move(next));
+    return id;
+}
+
+bool Exchange::removeSymbol(const Symb& symbol) {
+    std::lock_guard<std::mutex> lock(listingMutex_);
+    auto it = currentListing_->bySymbol.find(symbol);
+    if (it == currentListing_->bySymbol.end()) return false;
+    AssetContext* ac = it->second;
+
+    auto next = std::make_unique<Listing>(*currentListing_);
+    next->bySymbol.erase(symbol);
+    next->byId[ac->id_] = nullptr;
+    // Past this, nothing can route to ac and everything that did is queued
+    // on its strand
+    publish(std::move(next));
+
+    // Drain: the cancels run after every queued request, and each one is
+    // journaled as the order's final state
+    std::promise<uint64_t> drained;
+    ac->strand_->post([this, ac, &drained]() {
+        auto outcome = matchingEngine_.process_request(*ac->orderBook_, MassCancelRequest(ac->symbol_), Clock::now());
+        if (replicator_) {
+            // The backup runs the same drain when it delists
+            ac->replicationBody_.clear();
+            replicate(*ac, replication::FrameType::DELIST, ac->orderBook_->now_);
+        }
+        drained.set_value(onRequestProcessed(outcome));
+    });
+    logger_->waitForCommit(drained.get_future().get());
+
+    // Freed on the shard thread: the strand may still be unwinding from that
+    // last task there, and the book's memory belongs to the shard
+    std::unique_ptr<AssetContext> owned = std::move(assets_[ac->id_]);
+    Shard* shard = ac->shard_;
+    shard->run([&owned]() { owned.reset(); });
+    return true;
+}
+
+Exchange::Stats Exchange::stats() {
+    std::lock_guard<std::mutex> lock(listingMutex_);
+    Stats stats{.rebalances = {rebalances_.begin(), rebalances_.end()}, .rebalance_count = rebalanceCount_};
+    for (const auto& shard : shards_) {
+        stats.shards.push_back(ShardStats{
+            .index = shard->index(),
+            .cpu = shard->cpu(),
+            .node = shard->node(),
+            .symbols = 0,
+            .request_rate = 0,
+            .queue_depth = 0,
+            .huge_pages = shard->arena().hugePages(),
+            .arena_used = shard->arena().used(),
+            .arena_capacity = shard->arena().capacity(),
+            .perf_counters = shard->perf() != nullptr,
+            .perf = shard->perf() ? shard->perf()->totals() : std::array<PerfTotals, kRequestTypes>{}
+        });
+    }
+    for (const auto& ac : assets_) {
+        if (!ac) continue;
+        size_t depth = ac->strand_->pending();
+        ShardStats& shard = stats.shards[ac->shard_->index()];
+        ++shard.symbols;
+        shard.request_rate += ac->rate_;
+        shard.queue_depth += depth;
+        stats.symbols.push_back(SymbolStats{
+            .symbol = ac->symbol_,
+            .id = ac->id_,
+            .shard = ac->shard_->index(),
+            .requests = ac->requests_.load(std::memory_order_relaxed),
+            .request_rate = ac->rate_,
+            .queue_depth = depth
+        });
+    }
+    return stats;
+}
+
+std::optional<Exchange::RebalanceDecision> Exchange::rebalance() {
+    std::lock_guard<std::mutex> lock(listingMutex_);
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastSample_).count();
+    lastSample_ = now;
+
+    std::vector<double> shardRates(shards_.size(), 0.0);
+    std::vector<std::vector<AssetContext*>> owned(shards_.size());
+    for (auto& ac : assets_) {
+        if (!ac) continue;
+        uint64_t requests = ac->requests_.load(std::memory_order_relaxed);
+        ac->rate_ = seconds > 0 ? static_cast<double>(requests - ac->sampledRequests_) / seconds : 0.0;
+        ac->sampledRequests_ = requests;
+        shardRates[ac->shard_->index()] += ac->rate_;
+        owned[ac->shard_->index()].push_back(ac.get());
+    }
+
+    auto [coldest, hottest] = std::minmax_element(shardRates.begin(), shardRates.end());
+    size_t hot = static_cast<size_t>(hottest - shardRates.begin());
+    size_t cold = static_cast<size_t>(coldest - shardRates.begin());
+    if (hot == cold || *hottest < shardConfig_.rebalance_min_rate ||
+        *hottest < shardConfig_.rebalance_ratio * *coldest) {
+        return std::nullopt;
+    }
+
+    // The symbol whose move brings the peak down the most; moving a shard's
+    // only symbol just moves the hot spot, so it never qualifies
+    AssetContext* best = nullptr;
+    double bestPeak = *hottest;
+    for (AssetContext* ac : owned[hot]) {
+        double peak = std::max(*hottest - ac->rate_, *coldest + ac->rate_);
+        if (peak < bestPeak) {
+            best = ac;
+            bestPeak = peak;
+        }
+    }
+    if (!best) return std::nullopt;
+
+    RebalanceDecision decision{
+        .wall_ns = Clock::toWallNanos(Clock::now()),
+        .symbol = best->symbol_,
+        .from_shard = hot,
+        .to_shard = cold,
+        .symbol_rate = best->rate_,
+        .from_rate = *hottest,
+        .to_rate = *coldest
+    };
+    migrate(*best, *shards_[cold]);
+    rebalances_.push_back(decision);
+    if (rebalances_.size() > 64) rebalances_.pop_front();
+    ++rebalanceCount_;
+    return decision;
+}
+
+void Exchange::migrate(AssetContext& ac, Shard& to) {
+    // Runs between two requests of the symbol, on its current shard. The new
+    // shard rebuilds the book's containers in its own memory while this one
+    // waits; the old containers are then freed here, into the memory they
+    // came from. Later tasks keep their order in the strand's queue and
+    // simply run on the new pool.
+    std::promise<void> moved;
+    ac.strand_->post([&ac, &to, &moved]() {
+        std::unique_ptr<OrderBook> book;
+        to.run([&ac, &to, &book]() {
+            book = std::make_unique<OrderBook>(std::move(*ac.orderBook_), to.memory());
+        });
+        ac.orderBook_ = std::move(book);
+        ac.shard_ = &to;
+        ac.strand_->rebind(to.pool());
+        moved.set_value();
+    });
+    moved.get_future().wait();
+}
+
+void Exchange::rebalanceLoop() {
+    std::unique_lock<std::mutex> lock(rebalanceMutex_);
+    while (!rebalanceWake_.wait_for(lock, shardConfig_.rebalance_interval, [this] { return stopRebalancing_; })) {
+        lock.unlock();
+        rebalance();
+        lock.lock();
+    }
+}
+
+void Exchange::publish(std::unique_ptr<const Listing> next) {
+    listing_.store(next.get(), std::memory_order_release);
+    epoch_.synchronize();
+    currentListing_ = std::move(next);
+}
+
+Exchange::AssetContext* Exchange::findAsset(std::string_view symbol) const {
+    const Listing* listing = listing_.load(std::memory_order_acquire);
+    auto it = listing->bySymbol.find(symbol);
+    return it == listing->bySymbol.end() ? nullptr : it->second;
+}
+
+Exchange::AssetContext* Exchange::findAsset(SymbolId id) const {
+    const Listing* listing = listing_.load(std::memory_order_acquire);
+    return id < listing->byId.size() ? listing->byId[id] : nullptr;
 }
 
 void Exchange::shutdown() {
-    threadPool_.shutdown();
+    {
+        std::lock_guard<std::mutex> lock(rebalanceMutex_);
+        stopRebalancing_ = true;
+    }
+    rebalanceWake_.notify_all();
+    if (rebalanceThread_.joinable()) {
+        rebalanceThread_.join();
+    }
+    if (replica_) {
+        replica_->stop();
+    }
+    for (auto& shard : shards_) {
+        shard->shutdown();
+    }
+    if (replicator_) {
+        replicator_->shutdown();
+    }
     if (logger_) {
         logger_->shutdown();
     }
 }
 
-void Exchange::onRequestProcessed(const RequestOutcome& outcome) {
+uint64_t Exchange::onRequestProcessed(const RequestOutcome& outcome) {
     // Log the outcome using the logger
-    logger_->logRequestOutcome(outcome);
+    tracing::Span span("journal_enqueue");
+    return logger_->logRequestOutcome(outcome);
 }
\ No newline at end of file
@@ -0,0 +1,364 @@
+#include "gateway.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    std::system_error socketError(const char* what) {
+        return std::system_error(errno, std::generic_category(), what);
+    }
+}
+
+Gateway::IoThread::~IoThread() {
+    if (epollFd >= 0) ::close(epollFd);
+    if (wakeFd >= 0) ::close(wakeFd);
+}
+
+void Gateway::IoThread::wake() {
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(wakeFd, &one, sizeof(one));
+}
+
+Gateway::Gateway(Exchange& exchange, uint16_t port, Config config)
+    : exchange_(exchange), config_(config) {
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) throw socketError("gateway socket");
+    int on = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd_, SOMAXCONN) != 0) {
+        auto error = socketError("gateway bind");
+        ::close(listenFd_);
+        throw error;
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    for (size_t i = 0; i < std::max<size_t>(config_.io_threads, 1); ++i) {
+        auto io = std::make_shared<IoThread>();
+        io->epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        io->wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = io->wakeFd;
+        ::epoll_ctl(io->epollFd, EPOLL_CTL_ADD, io->wakeFd, &ev);
+        ioThreads_.push_back(std::move(io));
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd_;
+    ::epoll_ctl(ioThreads_[0]->epollFd, EPOLL_CTL_ADD, listenFd_, &ev);
+
+    for (auto& io : ioThreads_) {
+        io->thread = std::thread(&Gateway::ioLoop, this, std::ref(*io));
+    }
+}
+
+Gateway::~Gateway() {
+    shutdown();
+}
+
+void Gateway::shutdown() {
+    if (stop_.exchange(true)) return;
+    for (auto& io : ioThreads_) {
+        io->wake();
+    }
+    for (auto& io : ioThreads_) {
+        if (io->thread.joinable()) io->thread.join();
+        for (auto& [fd, session] : io->sessions) {
+            std::lock_guard<std::mutex> lock(session->txMutex);
+            session->closed = true;
+            ::close(fd);
+            if (session->loggedOn) exchange_.detachClient(session->client);
+        }
+        io->sessions.clear();
+        for (auto& session : io->pendingAccepts) ::close(session->fd);
+        io->pendingAccepts.clear();
+    }
+    loggedOnClients_.clear();
+    ::close(listenFd_);
+    listenFd_ = -1;
+    // Sessions still referenced by in-flight completions see their owner expire
+    ioThreads_.clear();
+}
+
+void Gateway::ioLoop(IoThread& io) {
+    epoll_event events[64];
+    while (!stop_.load(std::memory_order_acquire)) {
+        int ready = ::epoll_wait(io.epollFd, events, 64, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: gateway epoll_wait: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd_) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == io.wakeFd) {
+                uint64_t count;
+                [[maybe_unused]] ssize_t n = ::read(io.wakeFd, &count, sizeof(count));
+                std::vector<SessionPtr> accepts, writes;
+                {
+                    std::lock_guard<std::mutex> lock(io.pendingMutex);
+                    accepts.swap(io.pendingAccepts);
+                    writes.swap(io.pendingWrites);
+                }
+                for (auto& session : accepts) adopt(io, session);
+                for (auto& session : writes) {
+                    auto live = io.sessions.find(session->fd);
+                    if (live == io.sessions.end() || live->second != session) continue;
+                    bool overflowed;
+                    {
+                        std::lock_guard<std::mutex> lock(session->txMutex);
+                        overflowed = session->overflowed;
+                    }
+                    if (overflowed) {
+                        closeSession(io, session);
+                    } else {
+                        flush(io, *session);
+                    }
+                }
+                continue;
+            }
+
+            auto it = io.sessions.find(fd);
+            if (it == io.sessions.end()) continue;
+            SessionPtr session = it->second;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                onReadable(io, session);
+            }
+            if ((events[i].events & EPOLLOUT) && io.sessions.count(fd)) {
+                flush(io, *session);
+            }
+        }
+    }
+}
+
+void Gateway::acceptConnections() {
+    while (true) {
+        int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error: gateway accept: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        auto session = std::make_shared<Session>();
+        session->fd = fd;
+        session->rx.resize(kRecvChunk);
+        session->maxTx = config_.max_tx_bytes;
+
+        auto& io = ioThreads_[nextIo_++ % ioThreads_.size()];
+        session->owner = io;
+        if (io == ioThreads_[0]) {
+            adopt(*io, session);  // we are this thread
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(io->pendingMutex);
+                io->pendingAccepts.push_back(std::move(session));
+            }
+            io->wake();
+        }
+    }
+}
+
+void Gateway::adopt(IoThread& io, const SessionPtr& session) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = session->fd;
+    ::epoll_ctl(io.epollFd, EPOLL_CTL_ADD, session->fd, &ev);
+    io.sessions.emplace(session->fd, session);
+}
+
+void Gateway::onReadable(IoThread& io, const SessionPtr& session) {
+    Session& s = *session;
+    while (true) {
+        if (s.rx.size() - s.rxLen < kRecvChunk) s.rx.resize(s.rxLen + kRecvChunk);
+        ssize_t n = ::recv(s.fd, s.rx.data() + s.rxLen, s.rx.size() - s.rxLen, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            closeSession(io, session);  // orderly close or error
+            return;
+        }
+        s.rxLen += static_cast<size_t>(n);
+
+        // Decode every complete message in place
+        size_t offset = 0;
+        while (s.rxLen - offset >= sizeof(wire::Header)) {
+            const auto* hdr = wire::view<wire::Header>(s.rx.data() + offset, s.rxLen - offset);
+            uint32_t length = hdr->length;
+            if (length < sizeof(wire::Header) || length > kMaxMessage || hdr->version != wire::kVersion) {
+                closeSession(io, session);
+                return;
+            }
+            if (s.rxLen - offset < length) break;
+            if (!onMessage(session, s.rx.data() + offset, length)) {
+                closeSession(io, session);
+                return;
+            }
+            offset += length;
+        }
+        // Keep the partial tail for the next read
+        if (offset > 0) {
+            std::memmove(s.rx.data(), s.rx.data() + offset, s.rxLen - offset);
+            s.rxLen -= offset;
+        }
+    }
+}
+
+bool Gateway::onMessage(const SessionPtr& session, const char* data, size_t length) {
+    const auto* hdr = wire::view<wire::Header>(data, length);
+    if (hdr->type != wire::MsgType::LOGON && !session->loggedOn) return false;
+
+    switch (hdr->type) {
+        case wire::MsgType::LOGON: {
+            const auto* msg = wire::view<wire::Logon>(data, length);
+            if (!msg || session->loggedOn) return false;
+            session->client.assign(msg->client_id, strnlen(msg->client_id, wire::kClientIdLength));
+            // One session per client, so cancel on disconnect only takes
+            // down orders that session could have entered
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex_);
+                if (!loggedOnClients_.insert(session->client).second) return false;
+            }
+            // Refused here rather than on every request once the exchange
+            // is tracking all the clients it can
+            if (!exchange_.attachClient(session->client)) {
+                std::lock_guard<std::mutex> lock(clientsMutex_);
+                loggedOnClients_.erase(session->client);
+                return false;
+            }
+            session->loggedOn = true;
+            wire::LogonAck ack{wire::header_for<wire::LogonAck>(wire::MsgType::LOGON_ACK)};
+            queueReply(session, reinterpret_cast<const char*>(&ack), sizeof(ack));
+            return true;
+        }
+        default: {
+            auto decoded = wire::decode_request(data, length, session->client);
+            if (!decoded) return false;
+            exchange_.submitRequest(decoded->symbol, std::move(decoded->request), reportTo(session));
+            return true;
+        }
+    }
+}
+
+void Gateway::flush(IoThread& io, Session& s) {
+    while (true) {
+        if (s.sendOffset == s.sending.size()) {
+            s.sending.clear();
+            s.sendOffset = 0;
+            {
+                std::lock_guard<std::mutex> lock(s.txMutex);
+                s.sending.swap(s.tx);
+            }
+            if (s.sending.empty()) break;
+        }
+        ssize_t n = ::send(s.fd, s.sending.data() + s.sendOffset, s.sending.size() - s.sendOffset, MSG_NOSIGNAL);
+        if (n >= 0) {
+            s.sendOffset += static_cast<size_t>(n);
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Socket full: finish from EPOLLOUT
+            if (!s.wantWrite) {
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLOUT;
+                ev.data.fd = s.fd;
+                ::epoll_ctl(io.epollFd, EPOLL_CTL_MOD, s.fd, &ev);
+                s.wantWrite = true;
+            }
+            return;
+        }
+        // Broken connection; the read side will see it and close
+        s.sending.clear();
+        s.sendOffset = 0;
+        return;
+    }
+    if (s.wantWrite) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = s.fd;
+        ::epoll_ctl(io.epollFd, EPOLL_CTL_MOD, s.fd, &ev);
+        s.wantWrite = false;
+    }
+}
+
+void Gateway::closeSession(IoThread& io, const SessionPtr& session) {
+    {
+        std::lock_guard<std::mutex> lock(session->txMutex);
+        session->closed = true;
+    }
+    ::epoll_ctl(io.epollFd, EPOLL_CTL_DEL, session->fd, nullptr);
+    io.sessions.erase(session->fd);
+    ::close(session->fd);
+    session->fd = -1;
+    if (session->loggedOn) {
+        if (config_.cancel_on_disconnect) {
+            // Posted behind everything this session already sent; not awaited
+            exchange_.cancelAllForClient(session->client, [](RequestOutcome&&) {});
+        }
+        exchange_.detachClient(session->client);
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        loggedOnClients_.erase(session->client);
+    }
+}
+
+Exchange::Completion Gateway::reportTo(const SessionPtr& session) {
+    return [session](RequestOutcome&& outcome) {
+        thread_local std::vector<char> scratch;
+        scratch.clear();
+        wire::encode_report(scratch, outcome);
+        queueReply(session, scratch.data(), scratch.size());
+    };
+}
+
+void Gateway::queueReply(const SessionPtr& session, const char* data, size_t length) {
+    auto io = session->owner.lock();
+    if (!io) return;
+
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(session->txMutex);
+        if (session->closed) return;
+        if (session->tx.size() + length > session->maxTx) {
+            // Slow reader: stop buffering and have its I/O thread drop it
+            session->closed = true;
+            session->overflowed = true;
+            std::vector<char>().swap(session->tx);
+            wasEmpty = true;
+        } else {
+            wasEmpty = session->tx.empty();
+            session->tx.insert(session->tx.end(), data, data + length);
+        }
+    }
+    // One wakeup per batch of reports; later ones ride along
+    if (wasEmpty) {
+        {
+            std::lock_guard<std::mutex> lock(io->pendingMutex);
+            io->pendingWrites.push_back(session);
+        }
+        io->wake();
+    }
+}
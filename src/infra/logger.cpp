@@ -1,19 +1,32 @@
 #include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+Logger::Logger(const std::string& logDirectory, JournalConfig config)
+    : logDirectory_(logDirectory), config_(config), shutdown_(false) {
 
-Logger::Logger(const std::string& logDirectory) 
-    : logDirectory_(logDirectory), shutdown_(false) {
-    
     createLogDirectory();
-    
-    orderLogFile_.open(logDirectory_ + "orders.log", std::ios::app);
-    tradeLogFile_.open(logDirectory_ + "trades.log", std::ios::app);
-    requestLogFile_.open(logDirectory_ + "requests.log", std::ios::app);
-    
-    if (!orderLogFile_.is_open() || !tradeLogFile_.is_open() || !requestLogFile_.is_open()) {
+
+    openJournal(orderLogFile_, "orders.log");
+    openJournal(tradeLogFile_, "trades.log");
+    openJournal(requestLogFile_, "requests.log");
+
+    if (orderLogFile_.fd < 0 || tradeLogFile_.fd < 0 || requestLogFile_.fd < 0) {
         std::cerr << "Error: Failed to open one or more log files in " << logDirectory_ << std::endl;
     }
-    
+
+    if (config_.trade_store) {
+        tradeStore_ = std::make_unique<TradeStoreWriter>(logDirectory_ + "trades");
+    }
+
     loggerThread_ = std::thread(&Logger::loggerLoop, this);
 }
 
@@ -22,30 +35,96 @@ Logger::~Logger() {
 }
 
 void Logger::logOrderEvent(const OrderLog& orderLog) {
+    bool wake;
     {
-        std::lock_guard<std::mutex> lock(queueMutex_);
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        waitForSpace(lock);
         if (shutdown_) return;
-        logQueue_.emplace(orderLog);
+        // Wake the writer only when it is idle or a group has filled up
+        wake = logQueue_.empty() || logQueue_.size() + 1 == config_.group_events;
+        logQueue_.emplace_back(orderLog);
+        ++enqueued_;
     }
-    queueCondition_.notify_one();
+    if (wake) queueCondition_.notify_one();
+}
+
+void Logger::logOrderEvents(std::vector<OrderLog>&& orderLogs) {
+    bool wake;
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        waitForSpace(lock);
+        if (shutdown_) return;
+        size_t before = logQueue_.size();
+        for (auto& orderLog : orderLogs) {
+            logQueue_.emplace_back(std::move(orderLog));
+        }
+        enqueued_ += orderLogs.size();
+        wake = before == 0 || (before < config_.group_events && logQueue_.size() >= config_.group_events);
+    }
+    if (wake) queueCondition_.notify_one();
 }
 
 void Logger::logTradeEvent(const TradeLog& tradeLog) {
+    bool wake;
     {
-        std::lock_guard<std::mutex> lock(queueMutex_);
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        waitForSpace(lock);
         if (shutdown_) return;
-        logQueue_.emplace(tradeLog);
+        wake = logQueue_.empty() || logQueue_.size() + 1 == config_.group_events;
+        logQueue_.emplace_back(tradeLog);
+        ++enqueued_;
     }
-    queueCondition_.notify_one();
+    if (wake) queueCondition_.notify_one();
 }
 
-void Logger::logRequestOutcome(const RequestOutcome& outcome) {
+void Logger::logChecksum(const ChecksumLog& checksumLog) {
+    bool wake;
     {
-        std::lock_guard<std::mutex> lock(queueMutex_);
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        waitForSpace(lock);
         if (shutdown_) return;
-        logQueue_.emplace(outcome);
+        wake = logQueue_.empty() || logQueue_.size() + 1 == config_.group_events;
+        logQueue_.emplace_back(checksumLog);
+        ++enqueued_;
+    }
+    if (wake) queueCondition_.notify_one();
+}
+
+uint64_t Logger::logRequestOutcome(const RequestOutcome& outcome) {
+    bool wake;
+    uint64_t seq;
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        waitForSpace(lock);
+        if (shutdown_) return 0;
+        wake = logQueue_.empty() || logQueue_.size() + 1 == config_.group_events;
+        logQueue_.emplace_back(outcome);
+        seq = ++enqueued_;
     }
-    queueCondition_.notify_one();
+    if (wake) queueCondition_.notify_one();
+    return seq;
+}
+
+void Logger::waitForSpace(std::unique_lock<std::mutex>& lock) {
+    spaceCondition_.wait(lock, [this] { return shutdown_ || logQueue_.size() < config_.max_queued_events; });
+}
+
+void Logger::whenCommitted(uint64_t seq, CommitCallback callback) {
+    {
+        std::lock_guard<std::mutex> lock(commitMutex_);
+        if (failed_) return;
+        if (committed_.load(std::memory_order_relaxed) < seq) {
+            pendingCommits_.emplace(seq, std::move(callback));
+            return;
+        }
+    }
+    callback();
+}
+
+bool Logger::waitForCommit(uint64_t seq) {
+    std::unique_lock<std::mutex> lock(commitMutex_);
+    commitCondition_.wait(lock, [this, seq] { return failed_ || committed_.load(std::memory_order_relaxed) >= seq; });
+    return committed_.load(std::memory_order_relaxed) >= seq;
 }
 
 void Logger::shutdown() {
@@ -54,64 +133,146 @@ void Logger::shutdown() {
         shutdown_ = true;
     }
     queueCondition_.notify_all();
-    
+    spaceCondition_.notify_all();
+
     if (loggerThread_.joinable()) {
         loggerThread_.join();
     }
-    
-    orderLogFile_.close();
-    tradeLogFile_.close();
-    requestLogFile_.close();
+
+    closeJournal(orderLogFile_);
+    closeJournal(tradeLogFile_);
+    closeJournal(requestLogFile_);
 }
 
 void Logger::loggerLoop() {
+    std::vector<LogEntry> batch;
     while (true) {
-        LogEntry entry(OrderLog{}); // Default initialization
-        
+        uint64_t upto;
+        bool stopping;
         {
             std::unique_lock<std::mutex> lock(queueMutex_);
             queueCondition_.wait(lock, [this] { return shutdown_ || !logQueue_.empty(); });
-            
-            if (shutdown_ && logQueue_.empty()) {
+
+            if (config_.durability == Durability::GROUP_COMMIT) {
+                // Hold the group open until it is old enough or big enough
+                auto deadline = std::chrono::steady_clock::now() + config_.group_interval;
+                queueCondition_.wait_until(lock, deadline, [this] {
+                    return shutdown_ || logQueue_.size() >= config_.group_events;
+                });
+            }
+
+            batch.swap(logQueue_);
+            upto = enqueued_;
+            stopping = shutdown_;
+        }
+        spaceCondition_.notify_all();
+
+        for (const auto& entry : batch) {
+            writeEntry(entry);
+        }
+        batch.clear();
+        commit(upto);
+
+        // Producers stop enqueueing once shutdown_ is set, so this batch was the last
+        if (stopping || failed_) return;
+    }
+}
+
+void Logger::writeEntry(const LogEntry& entry) {
+    std::visit([this](const auto& event) {
+        using T = std::decay_t<decltype(event)>;
+        // Checksums go with the order events they summarise
+        JournalFile& file = std::is_same_v<T, OrderLog> || std::is_same_v<T, ChecksumLog> ? orderLogFile_
+                          : std::is_same_v<T, TradeLog> ? tradeLogFile_
+                          : requestLogFile_;
+        file.out << event << '\n';
+        if constexpr (std::is_same_v<T, TradeLog>) {
+            if (tradeStore_) tradeStore_->append(event);
+        }
+    }, entry);
+}
+
+bool Logger::writeJournal(JournalFile& file) {
+    if (!file.dirty() || file.fd < 0) return true;
+    if (!file.buffer.writeTo(file.fd, file.offset)) {
+        std::cerr << "Error: journal write failed in " << logDirectory_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (config_.durability != Durability::NONE && ::fdatasync(file.fd) != 0) {
+        std::cerr << "Error: journal sync failed in " << logDirectory_ << ": " << std::strerror(errno) << std::endl;
+        // Whether the written pages survived is unknown: write the batch again
+        file.offset -= static_cast<off_t>(file.buffer.rewind());
+        return false;
+    }
+    file.buffer.release();
+    return true;
+}
+
+void Logger::commit(uint64_t upto) {
+    // The watermark only moves once every file holds the batch. Until then
+    // the batch is retried and the queue fills, which blocks producers
+    auto backoff = std::chrono::milliseconds(1);
+    while (true) {
+        bool ok = true;
+        for (JournalFile* file : {&orderLogFile_, &tradeLogFile_, &requestLogFile_}) {
+            ok = writeJournal(*file) && ok;
+        }
+        if (ok) break;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueCondition_.wait_for(lock, backoff, [this] { return shutdown_.load(); });
+            if (shutdown_) {
+                failJournal();
                 return;
             }
-            
-            entry = std::move(logQueue_.front());
-            logQueue_.pop();
         }
-        
-        switch (entry.type) {
-            case LogEntry::ORDER_EVENT:
-                writeOrderEvent(entry.orderLog);
-                break;
-            case LogEntry::TRADE_EVENT:
-                writeTradeEvent(entry.tradeLog);
-                break;
-            case LogEntry::REQUEST_OUTCOME:
-                writeRequestOutcome(entry.requestOutcome);
-                break;
+        backoff = std::min(backoff * 2, std::chrono::milliseconds(1000));
+    }
+
+    // Trades are queryable from the store once their batch is committed
+    if (tradeStore_) tradeStore_->flush(config_.durability != Durability::NONE);
+
+    std::vector<CommitCallback> ready;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex_);
+        committed_.store(upto, std::memory_order_release);
+        auto last = pendingCommits_.upper_bound(upto);
+        for (auto it = pendingCommits_.begin(); it != last; ++it) {
+            ready.push_back(std::move(it->second));
         }
+        pendingCommits_.erase(pendingCommits_.begin(), last);
+    }
+    commitCondition_.notify_all();
+    for (auto& callback : ready) {
+        callback();
     }
 }
 
-void Logger::writeOrderEvent(const OrderLog& orderLog) {
-    if (orderLogFile_.is_open()) {
-        orderLogFile_ << orderLog << std::endl;
-        orderLogFile_.flush();
+void Logger::failJournal() {
+    std::cerr << "Error: giving up on uncommitted journal events in " << logDirectory_ << std::endl;
+    std::multimap<uint64_t, CommitCallback> dropped;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex_);
+        failed_ = true;
+        dropped.swap(pendingCommits_);
     }
+    commitCondition_.notify_all();
+    // Destroyed without running: acks waiting on them never report success
 }
 
-void Logger::writeTradeEvent(const TradeLog& tradeLog) {
-    if (tradeLogFile_.is_open()) {
-        tradeLogFile_ << tradeLog << std::endl;
-        tradeLogFile_.flush();
+void Logger::openJournal(JournalFile& file, const std::string& name) {
+    std::string path = logDirectory_ + name;
+    file.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (file.fd >= 0) {
+        // Positional writes from the current end; the writer thread is the only appender
+        file.offset = ::lseek(file.fd, 0, SEEK_END);
     }
 }
 
-void Logger::writeRequestOutcome(const RequestOutcome& outcome) {
-    if (requestLogFile_.is_open()) {
-        requestLogFile_ << outcome << std::endl;
-        requestLogFile_.flush();
+void Logger::closeJournal(JournalFile& file) {
+    if (file.fd >= 0) {
+        ::close(file.fd);
+        file.fd = -1;
     }
 }
 
@@ -121,4 +282,95 @@ void Logger::createLogDirectory() {
     } catch (const std::filesystem::filesystem_error& e) {
         std::cerr << "Error creating log directory " << logDirectory_ << ": " << e.what() << std::endl;
     }
-}
\ No newline at end of file
+}
+
+Logger::ChunkBuffer::~ChunkBuffer() {
+    for (char* chunk : chunks_) std::free(chunk);
+    for (char* chunk : spare_) std::free(chunk);
+}
+
+Logger::ChunkBuffer::int_type Logger::ChunkBuffer::overflow(int_type ch) {
+    nextChunk();
+    if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+}
+
+std::streamsize Logger::ChunkBuffer::xsputn(const char* s, std::streamsize n) {
+    std::streamsize written = 0;
+    while (written < n) {
+        if (pptr() == epptr()) nextChunk();
+        auto count = std::min<std::streamsize>(n - written, epptr() - pptr());
+        std::memcpy(pptr(), s + written, static_cast<size_t>(count));
+        pbump(static_cast<int>(count));
+        written += count;
+    }
+    return written;
+}
+
+void Logger::ChunkBuffer::nextChunk() {
+    char* chunk;
+    if (!spare_.empty()) {
+        chunk = spare_.back();
+        spare_.pop_back();
+    } else {
+        chunk = static_cast<char*>(std::aligned_alloc(kChunkAlign, kChunkBytes));
+        if (!chunk) throw std::bad_alloc();
+    }
+    chunks_.push_back(chunk);
+    setp(chunk, chunk + kChunkBytes);
+}
+
+bool Logger::ChunkBuffer::writeTo(int fd, off_t& offset) {
+    // Everything not yet written, resuming after an earlier failure
+    std::vector<iovec> iov;
+    iov.reserve(chunks_.size());
+    size_t skip = sent_;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        size_t len = i + 1 < chunks_.size() ? kChunkBytes : static_cast<size_t>(pptr() - pbase());
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        iov.push_back(iovec{chunks_[i] + skip, len - skip});
+        skip = 0;
+    }
+
+    size_t first = 0;
+    while (first < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+        ssize_t written = ::pwritev(fd, &iov[first], count, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += written;
+        sent_ += static_cast<size_t>(written);
+        // Skip what went out, trimming a partially written chunk
+        while (written > 0) {
+            if (static_cast<size_t>(written) >= iov[first].iov_len) {
+                written -= static_cast<ssize_t>(iov[first].iov_len);
+                ++first;
+            } else {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+                iov[first].iov_len -= static_cast<size_t>(written);
+                written = 0;
+            }
+        }
+    }
+    return true;
+}
+
+size_t Logger::ChunkBuffer::rewind() {
+    size_t sent = sent_;
+    sent_ = 0;
+    return sent;
+}
+
+void Logger::ChunkBuffer::release() {
+    spare_.insert(spare_.end(), chunks_.begin(), chunks_.end());
+    chunks_.clear();
+    sent_ = 0;
+    setp(nullptr, nullptr);
+}
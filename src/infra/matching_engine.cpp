@@ -1,15 +1,81 @@
 #include "matching_engine.h"
+#include "tracing.h"
 #include <algorithm>
-#include <chrono>
+#include <cmath>
 
-// Static member definitions
-std::unordered_map<std::string, std::atomic<uint64_t>> MatchingEngine::order_sequences_;
-std::unordered_map<std::string, std::atomic<uint64_t>> MatchingEngine::trade_sequences_;
+namespace {
+    // Push-front / unlink on a client list whose nodes are the handle entries
+    template<class Index>
+    void link_client(ClientHeads& heads, Index& index, const ClientId& client, OrdId id) {
+        auto& node = index.at(id);
+        node.client_prev = kNoOrder;
+        auto [head, inserted] = heads.try_emplace(client, id);
+        if (inserted) {
+            node.client_next = kNoOrder;
+        } else {
+            node.client_next = head->second;
+            index.at(head->second).client_prev = id;
+            head->second = id;
+        }
+    }
+
+    template<class Index>
+    void unlink_client(ClientHeads& heads, Index& index, const ClientId& client, OrdId id) {
+        auto& node = index.at(id);
+        if (node.client_next != kNoOrder) {
+            index.at(node.client_next).client_prev = node.client_prev;
+        }
+        if (node.client_prev != kNoOrder) {
+            index.at(node.client_prev).client_next = node.client_next;
+        } else if (node.client_next != kNoOrder) {
+            heads[client] = node.client_next;
+        } else {
+            heads.erase(client);
+        }
+    }
+
+    // Open quantity, counting an iceberg's hidden reserve
+    Qty open_quantity(const Order& order) {
+        return std::visit([](const auto& ord) -> Qty {
+            if constexpr (requires { ord.hidden_quantity; }) return ord.meta.remaining_quantity + ord.hidden_quantity;
+            else return ord.meta.remaining_quantity;
+        }, order);
+    }
+
+    // Take qty off the visible slice, refilling an iceberg from its reserve
+    void consume(Order& order, Qty qty) {
+        std::visit([qty](auto& ord) {
+            Qty left = qty;
+            while (true) {
+                Qty take = std::min(left, ord.meta.remaining_quantity);
+                ord.meta.remaining_quantity -= take;
+                left -= take;
+                if constexpr (requires { ord.replenish(); }) {
+                    if (ord.meta.remaining_quantity == 0 && ord.hidden_quantity > 0) {
+                        ord.replenish();
+                        continue;
+                    }
+                }
+                break;
+            }
+        }, order);
+    }
 
-template<class... Ts> struct Overloaded : Ts... { using Ts::operator()...; };
-template<class... Ts> Overloaded(Ts...) -> Overloaded<Ts...>;
+    // Someone else's order looks the same as no order at all
+    RequestOutcome not_owned(ReqId request_id) {
+        return RequestOutcome{
+            .request_id = request_id,
+            .status = RequestStatus::REJECTED,
+            .reason = RejectReason::UNKNOWN_ORDER,
+            .message = "Order not found"
+        };
+    }
+}
 
-RequestOutcome MatchingEngine::process_request(OrderBook& book, TradingRequest&& tr) {
+RequestOutcome MatchingEngine::process_request(OrderBook& book, TradingRequest&& tr, Timestamp ingress) {
+    // Callers stamp before posting to the strand; never let a book's clock
+    // run backwards or time priority would disagree with arrival order
+    book.now_ = std::max(book.now_, ingress);
     auto request_visitor = Overloaded{
         [this, &book](NewOrderRequest&& r) -> RequestOutcome { 
             auto order = create_order(r.order_type, r.params);
@@ -18,14 +84,14 @@ RequestOutcome MatchingEngine::process_request(OrderBook& book, TradingRequest&&
                     .request_id = r.request_id,
                     .status = RequestStatus::REJECTED,
                     .reason = RejectReason::INVALID_PRICE,
-                    .message = "Invalid order type: " + r.order_type
+                    .message = "Invalid order type: " + std::string(order_kind_name(r.order_type))
                 };
                 
                 // Generate OrderLog event for REJECTED
                 OrderLog order_log{
                     .symbol = "UNKNOWN", // We don't know symbol at this point
-                    .seq = get_next_order_sequence("UNKNOWN"),
-                    .ts = std::chrono::steady_clock::now(),
+                    .seq = get_next_order_sequence(book),
+                    .ts = book.now_,
                     .type = OrderEventType::REJECTED,
                     .order_id = 0, // No valid order ID
                     .reason = RejectReason::INVALID_PRICE
@@ -34,19 +100,107 @@ RequestOutcome MatchingEngine::process_request(OrderBook& book, TradingRequest&&
                 
                 return outcome;
             }
+            // Resolve time in force to an absolute expiry
+            auto& order_meta = std::visit([](auto& ord) -> OrderMeta& { return ord.meta; }, *order);
+            if (book.order_handles_.count(order_meta.order_id) || book.stop_handles_.count(order_meta.order_id)) {
+                // Reusing a live id would overwrite its handle and client list links
+                OrderLog order_log{
+                    .symbol = book.symbol_,
+                    .seq = get_next_order_sequence(book),
+                    .ts = book.now_,
+                    .type = OrderEventType::REJECTED,
+                    .order_id = order_meta.order_id,
+                    .side = order_meta.side,
+                    .price = order_meta.price,
+                    .remaining_qty = order_meta.remaining_quantity,
+                    .reason = RejectReason::DUPLICATE_ORDER_ID
+                };
+                order_logger_(order_log);
+
+                return RequestOutcome{
+                    .request_id = r.request_id,
+                    .status = RequestStatus::REJECTED,
+                    .reason = RejectReason::DUPLICATE_ORDER_ID,
+                    .message = "Order id " + std::to_string(order_meta.order_id) + " is already live"
+                };
+            }
+            order_meta.timestamp = book.now_;
+            if (r.params.tif == TimeInForce::GTD) {
+                if (!r.params.expire_at) {
+                    return RequestOutcome{
+                        .request_id = r.request_id,
+                        .status = RequestStatus::REJECTED,
+                        .reason = RejectReason::INVALID_EXPIRY,
+                        .message = "GTD order requires an expiry time"
+                    };
+                }
+                order_meta.expire_at = *r.params.expire_at;
+            } else if (r.params.tif == TimeInForce::DAY) {
+                order_meta.expire_at = book.session_close_;
+            }
+
+            if (risk_manager_) {
+                const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, *order);
+                // A stop market order fires at its stop price, the nearest
+                // guide to what it will trade at; other market orders go by
+                // the last trade
+                Px ref_price = std::visit([&book](const auto& ord) -> Px {
+                    if (ord.meta.price > 0.0) return ord.meta.price;
+                    if constexpr (requires { ord.stop_price; }) return ord.stop_price;
+                    else return book.last_trade_price_.value_or(0.0);
+                }, *order);
+                auto decision = check_risk(book, meta, ref_price, meta.original_quantity);
+                if (!decision.accepted) {
+                    OrderLog order_log{
+                        .symbol = book.symbol_,
+                        .seq = get_next_order_sequence(book),
+                        .ts = book.now_,
+                        .type = OrderEventType::REJECTED,
+                        .order_id = meta.order_id,
+                        .side = meta.side,
+                        .price = meta.price,
+                        .remaining_qty = meta.remaining_quantity,
+                        .reason = RejectReason::RISK_LIMIT_BREACHED
+                    };
+                    order_logger_(order_log);
+
+                    return RequestOutcome{
+                        .request_id = r.request_id,
+                        .status = RequestStatus::REJECTED,
+                        .reason = RejectReason::RISK_LIMIT_BREACHED,
+                        .message = "Risk limit breached: " + std::string(decision.breach)
+                    };
+                }
+            }
             auto outcome = submit_order(book, std::move(order));
             outcome.request_id = r.request_id;
             return outcome;
         },
         [this, &book](CancelOrderRequest&& r) -> RequestOutcome {
+            if (r.client_id && !owned_by(book, r.order_id, *r.client_id)) {
+                return not_owned(r.request_id);
+            }
             auto outcome = cancel_order(book, r.order_id);
             outcome.request_id = r.request_id;
             return outcome;
         },
         [this, &book](ModifyOrderRequest&& r) -> RequestOutcome {
+            if (r.client_id && !owned_by(book, r.order_id, *r.client_id)) {
+                return not_owned(r.request_id);
+            }
             auto outcome = modify_order(book, r.order_id, r.new_price, r.new_quantity);
             outcome.request_id = r.request_id;
             return outcome;
+        },
+        [this, &book](MassCancelRequest&& r) -> RequestOutcome {
+            auto outcome = mass_cancel(book, r.client_id, r.side);
+            outcome.request_id = r.request_id;
+            return outcome;
+        },
+        [this, &book](TradingPhaseRequest&& r) -> RequestOutcome {
+            auto outcome = change_phase(book, r.phase);
+            outcome.request_id = r.request_id;
+            return outcome;
         }
     };
     
@@ -54,14 +208,31 @@ RequestOutcome MatchingEngine::process_request(OrderBook& book, TradingRequest&&
 }
 
 RequestOutcome MatchingEngine::submit_order(OrderBook& book, std::unique_ptr<Order> order) {
+    auto outcome = route_order(book, std::move(order));
+    run_stop_triggers(book);
+    return outcome;
+}
+
+RequestOutcome MatchingEngine::route_order(OrderBook& book, std::unique_ptr<Order> order, bool triggered) {
+    if (book.phase_ != TradingPhase::CONTINUOUS) {
+        return accept_in_auction(book, std::move(order));
+    }
+
     auto order_visitor = Overloaded{
-        [this, &book](MarketOrder& ord) -> RequestOutcome {
-            auto order_ptr = std::make_unique<Order>(ord);
-            return match_market_order(std::move(order_ptr), book);
+        [this, &book, &order](MarketOrder&) -> RequestOutcome {
+            return match_market_order(std::move(order), book);
+        },
+        [this, &book, &order, triggered](LimitOrder&) -> RequestOutcome {
+            return match_limit_order(std::move(order), book, triggered);
+        },
+        [this, &book, &order, triggered](IcebergOrder&) -> RequestOutcome {
+            return match_limit_order(std::move(order), book, triggered);
         },
-        [this, &book](LimitOrder& ord) -> RequestOutcome {
-            auto order_ptr = std::make_unique<Order>(ord);
-            return match_limit_order(std::move(order_ptr), book);
+        [this, &book, &order](StopOrder&) -> RequestOutcome {
+            return park_stop_order(std::move(order), book);
+        },
+        [this, &book, &order](StopLimitOrder&) -> RequestOutcome {
+            return park_stop_order(std::move(order), book);
         }
     };
     return std::visit(order_visitor, *order);
@@ -70,6 +241,9 @@ RequestOutcome MatchingEngine::submit_order(OrderBook& book, std::unique_ptr<Ord
 RequestOutcome MatchingEngine::cancel_order(OrderBook& book, OrdId orderId) {
     auto& handles = book.order_handles_;
     auto handleIt = handles.find(orderId);
+    if (handleIt == handles.end() && book.stop_handles_.count(orderId)) {
+        return cancel_stop_order(book, orderId);
+    }
     if (handleIt == handles.end()) {
         RequestOutcome outcome;
         outcome.status = RequestStatus::REJECTED;
@@ -93,8 +267,8 @@ RequestOutcome MatchingEngine::cancel_order(OrderBook& book, OrdId orderId) {
         // Generate OrderLog event for CANCELED
         OrderLog order_log;
         order_log.symbol = book.symbol_;
-        order_log.seq = get_next_order_sequence(book.symbol_);
-        order_log.ts = std::chrono::steady_clock::now();
+        order_log.seq = get_next_order_sequence(book);
+        order_log.ts = book.now_;
         order_log.type = OrderEventType::CANCELED;
         order_log.order_id = order_meta.order_id;
         order_log.side = order_meta.side;
@@ -102,8 +276,10 @@ RequestOutcome MatchingEngine::cancel_order(OrderBook& book, OrdId orderId) {
         order_log.remaining_qty = order_meta.remaining_quantity;
         order_logger_(order_log);
         
+        note_order_removed(book, order_meta);
+        unlink_client_order(book, order_meta);
         bookSide.erase(bookSide.begin() + handle.vectorIndex);
-        update_handles_after_removal(handle.side, handle.vectorIndex, bookSide, handles);
+        update_handles_after_removal(handle.vectorIndex, bookSide, handles);
         handles.erase(handleIt);
         
         RequestOutcome outcome;
@@ -124,68 +300,229 @@ RequestOutcome MatchingEngine::modify_order(OrderBook& book, OrdId orderId, Px n
     
     auto handleIt = handles.find(orderId);
     if (handleIt == handles.end()) {
+        bool is_stop = book.stop_handles_.count(orderId) > 0;
         return RequestOutcome{
             .request_id = orderId,
             .status = RequestStatus::REJECTED,
-            .reason = RejectReason::UNKNOWN_ORDER,
-            .message = "Order not found"
+            .reason = is_stop ? RejectReason::NOT_MODIFIABLE : RejectReason::UNKNOWN_ORDER,
+            .message = is_stop ? "Pending stop orders cannot be modified" : "Order not found"
+        };
+    }
+    if (newQty == 0) {
+        return RequestOutcome{
+            .request_id = orderId,
+            .status = RequestStatus::REJECTED,
+            .reason = RejectReason::INVALID_QUANTITY,
+            .message = "Modify quantity must be positive"
         };
     }
     
     const OrderHandle& handle = handleIt->second;
     auto& bookSide = (handle.side == Side::BUY) ? book.bids_ : book.asks_;
-    auto order = &bookSide[handle.vectorIndex];
-    
-    // Get original order info
-    auto original_kName = std::visit([](const auto& ord) { return ord.kName; }, **order);
-    auto original_meta = std::visit([](const auto& ord) { return ord.meta; }, **order);
-
-    // Create new order parameters
-    NewOrderParams new_params{
-        .id = original_meta.order_id,
-        .client = original_meta.client_id,
-        .side = original_meta.side,
-        .price = newPx,
-        .qty = newQty
-    };
-    auto new_order = create_order(original_kName, new_params);
-    
-    // Generate OrderLog event for REPLACED
+    Order& order = *bookSide[handle.vectorIndex];
+    OrderMeta& meta = std::visit([](auto& ord) -> OrderMeta& { return ord.meta; }, order);
+
+    Qty open_qty = open_quantity(order);
+
+    if (newPx == meta.price && newQty == open_qty) {
+        return RequestOutcome{
+            .request_id = orderId,
+            .status = RequestStatus::NOOP,
+            .message = "Order unchanged",
+            .taker_remaining_qty = open_qty
+        };
+    }
+
+    // Same price, smaller size: shrink in place and keep queue position.
+    // Icebergs give up reserve before visible quantity.
+    if (newPx == meta.price && newQty < open_qty) {
+        Qty reduce_by = open_qty - newQty;
+        Qty before = meta.remaining_quantity;
+        std::visit([reduce_by](auto& ord) {
+            Qty left = reduce_by;
+            if constexpr (requires { ord.hidden_quantity; }) {
+                Qty from_hidden = std::min(left, ord.hidden_quantity);
+                ord.hidden_quantity -= from_hidden;
+                left -= from_hidden;
+            }
+            ord.meta.remaining_quantity -= left;
+        }, order);
+        meta.original_quantity -= reduce_by;
+        note_quantity_change(book, meta, before);
+
+        OrderLog order_log{
+            .symbol = book.symbol_,
+            .seq = get_next_order_sequence(book),
+            .ts = book.now_,
+            .type = OrderEventType::REPLACED,
+            .order_id = meta.order_id,
+            .side = meta.side,
+            .price = meta.price,
+            .remaining_qty = meta.remaining_quantity
+        };
+        order_logger_(order_log);
+
+        return RequestOutcome{
+            .request_id = orderId,
+            .status = RequestStatus::OK,
+            .message = "Order modified: quantity reduced in place",
+            .taker_remaining_qty = newQty
+        };
+    }
+
+    // Price change or size increase loses priority: pull the order out of the
+    // book, rewrite it and resubmit the same object (it may now cross). Either
+    // change moves the order's exposure, so check it again as the order it
+    // becomes: the whole new quantity at the new price.
+    if (risk_manager_) {
+        auto decision = check_risk(book, meta, newPx, newQty, true);
+        if (!decision.accepted) {
+            return RequestOutcome{
+                .request_id = orderId,
+                .status = RequestStatus::REJECTED,
+                .reason = RejectReason::RISK_LIMIT_BREACHED,
+                .message = "Risk limit breached: " + std::string(decision.breach)
+            };
+        }
+    }
+
     OrderLog order_log{
         .symbol = book.symbol_,
-        .seq = get_next_order_sequence(book.symbol_),
-        .ts = std::chrono::steady_clock::now(),
+        .seq = get_next_order_sequence(book),
+        .ts = book.now_,
         .type = OrderEventType::REPLACED,
-        .order_id = original_meta.order_id,
-        .side = original_meta.side,
+        .order_id = meta.order_id,
+        .side = meta.side,
         .price = newPx,
         .remaining_qty = newQty
     };
     order_logger_(order_log);
-    
-    // Remove old order and resubmit the modified order
-    remove_from_book(orderId, book);
-    auto result = submit_order(book, std::move(new_order));
+
+    auto replaced = remove_from_book(orderId, book);
+    std::visit([newPx, newQty, open_qty, &book](auto& ord) {
+        if constexpr (requires { ord.hidden_quantity; }) ord.hidden_quantity = 0;
+        ord.meta.original_quantity = ord.meta.original_quantity - open_qty + newQty;
+        ord.meta.remaining_quantity = newQty;
+        ord.meta.price = newPx;
+        ord.meta.timestamp = book.now_;
+    }, *replaced);
+
+    auto result = submit_order(book, std::move(replaced));
     result.message = "Order modified: " + result.message;
     return result;
 }
 
-uint64_t MatchingEngine::get_next_order_sequence(const std::string& symbol) {
-    return ++order_sequences_[symbol];
+RequestOutcome MatchingEngine::mass_cancel(OrderBook& book, const std::optional<ClientId>& client, std::optional<Side> side) {
+    auto wanted = [&side](Side s) { return !side || *side == s; };
+    Timestamp ts = book.now_;
+    std::vector<OrderLog> cancelled;
+
+    auto record = [&](Order& order) {
+        auto& meta = std::visit([](auto& ord) -> OrderMeta& { return ord.meta; }, order);
+        meta.state = OrdState::CANCELLED;
+        cancelled.push_back(OrderLog{
+            .symbol = book.symbol_,
+            .seq = get_next_order_sequence(book),
+            .ts = ts,
+            .type = OrderEventType::CANCELED,
+            .order_id = meta.order_id,
+            .side = meta.side,
+            .price = meta.price,
+            .remaining_qty = meta.remaining_quantity
+        });
+    };
+
+    // Resting orders: pull each victim out of its slot (walking only the
+    // client's list when scoped), then compact each side once
+    bool touched[2] = {false, false};
+    auto pull = [&](OrdId id) {
+        auto handle_it = book.order_handles_.find(id);
+        Side order_side = handle_it->second.side;
+        auto& book_side = (order_side == Side::BUY) ? book.bids_ : book.asks_;
+        auto order = std::move(book_side[handle_it->second.vectorIndex]);
+        const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, *order);
+        record(*order);
+        note_order_removed(book, meta);
+        unlink_client_order(book, meta);
+        book.order_handles_.erase(handle_it);
+        touched[order_side == Side::BUY ? 0 : 1] = true;
+    };
+
+    std::vector<OrdId> victims;
+    if (client) {
+        auto head = book.client_orders_.find(*client);
+        for (OrdId id = head == book.client_orders_.end() ? kNoOrder : head->second; id != kNoOrder;) {
+            const OrderHandle& node = book.order_handles_.at(id);
+            if (wanted(node.side)) victims.push_back(id);
+            id = node.client_next;
+        }
+    } else {
+        for (Side s : {Side::BUY, Side::SELL}) {
+            if (!wanted(s)) continue;
+            for (const auto& order : (s == Side::BUY) ? book.bids_ : book.asks_) {
+                victims.push_back(std::visit([](const auto& ord) { return ord.meta.order_id; }, *order));
+            }
+        }
+    }
+    for (OrdId id : victims) pull(id);
+
+    for (Side s : {Side::BUY, Side::SELL}) {
+        if (!touched[s == Side::BUY ? 0 : 1]) continue;
+        auto& book_side = (s == Side::BUY) ? book.bids_ : book.asks_;
+        std::erase_if(book_side, [](const std::unique_ptr<Order>& order) { return !order; });
+        reindex_handles(book_side, book.order_handles_);
+    }
+
+    // Pending stops
+    victims.clear();
+    if (client) {
+        auto head = book.client_stops_.find(*client);
+        for (OrdId id = head == book.client_stops_.end() ? kNoOrder : head->second; id != kNoOrder;) {
+            const StopHandle& node = book.stop_handles_.at(id);
+            if (wanted(node.side)) victims.push_back(id);
+            id = node.client_next;
+        }
+    } else {
+        for (const auto& [id, handle] : book.stop_handles_) {
+            if (wanted(handle.side)) victims.push_back(id);
+        }
+    }
+    for (OrdId id : victims) {
+        if (auto order = take_pending_stop(book, id)) record(*order);
+    }
+
+    size_t count = cancelled.size();
+    if (order_batch_logger_) {
+        order_batch_logger_(std::move(cancelled));
+    } else {
+        for (const auto& order_log : cancelled) order_logger_(order_log);
+    }
+
+    RequestOutcome outcome;
+    outcome.status = count > 0 ? RequestStatus::OK : RequestStatus::NOOP;
+    outcome.message = "Mass cancel: " + std::to_string(count) + " orders cancelled";
+    return outcome;
+}
+
+uint64_t MatchingEngine::get_next_order_sequence(OrderBook& book) {
+    return ++book.order_seq_;
 }
 
-uint64_t MatchingEngine::get_next_trade_sequence(const std::string& symbol) {
-    return ++trade_sequences_[symbol];
+uint64_t MatchingEngine::get_next_trade_sequence(OrderBook& book) {
+    return ++book.trade_seq_;
 }
 
-RequestOutcome MatchingEngine::match_limit_order(std::unique_ptr<Order> order_ptr, OrderBook& book) {
-    const auto& order = std::visit([](const auto& ord) -> const auto& { return ord; }, *order_ptr);
+RequestOutcome MatchingEngine::match_limit_order(std::unique_ptr<Order> order_ptr, OrderBook& book, bool triggered) {
+    auto side = std::visit([](const auto& ord) { return ord.meta.side; }, *order_ptr);
     
     // Get the opposite book for matching
-    auto& opposite_book = (order.meta.side == Side::BUY) ? book.asks_ : book.bids_;
+    auto& opposite_book = (side == Side::BUY) ? book.asks_ : book.bids_;
     
     // Match against opposite book - order_ptr will be moved inside
-    auto [fills, remaining_order] = match_against_book(std::move(order_ptr), opposite_book, book.order_handles_, book.symbol_);
+    auto [fills, remaining_order] = match_against_book(std::move(order_ptr), opposite_book, book);
+    if (!fills.empty()) {
+        book.last_trade_price_ = fills.back().price;
+    }
     
     // Calculate summary quantities
     Qty filled_qty = 0;
@@ -210,8 +547,11 @@ RequestOutcome MatchingEngine::match_limit_order(std::unique_ptr<Order> order_pt
     if (remaining_qty == 0) {
         outcome.message = "Limit order fully filled";
     } else {
-        // Add remaining quantity to book
-        insert_sorted(std::move(remaining_order), book);
+        // Add remaining quantity to book, icebergs showing only their first slice
+        std::visit([](auto& ord) {
+            if constexpr (requires { ord.hide_reserve(); }) ord.hide_reserve();
+        }, *remaining_order);
+        insert_sorted(std::move(remaining_order), book, !triggered);
         outcome.message = "Limit order partially filled and added to book";
     }
     
@@ -220,8 +560,8 @@ RequestOutcome MatchingEngine::match_limit_order(std::unique_ptr<Order> order_pt
 
 RequestOutcome MatchingEngine::match_market_order(std::unique_ptr<Order> order_ptr, OrderBook& book) {
     // Market orders must execute immediately or be rejected
-    const auto& order = std::visit([](const auto& ord) -> const auto& { return ord; }, *order_ptr);
-    auto& opposite_book = (order.meta.side == Side::BUY) ? book.asks_ : book.bids_;
+    auto side = std::visit([](const auto& ord) { return ord.meta.side; }, *order_ptr);
+    auto& opposite_book = (side == Side::BUY) ? book.asks_ : book.bids_;
     
     if (opposite_book.empty()) {
         RequestOutcome outcome;
@@ -231,7 +571,10 @@ RequestOutcome MatchingEngine::match_market_order(std::unique_ptr<Order> order_p
         return outcome;
     }
     
-    auto [fills, remaining_order] = match_against_book(std::move(order_ptr), opposite_book, book.order_handles_, book.symbol_);
+    auto [fills, remaining_order] = match_against_book(std::move(order_ptr), opposite_book, book);
+    if (!fills.empty()) {
+        book.last_trade_price_ = fills.back().price;
+    }
     
     // Calculate summary quantities
     Qty filled_qty = 0;
@@ -263,172 +606,854 @@ RequestOutcome MatchingEngine::match_market_order(std::unique_ptr<Order> order_p
     return outcome;
 }
 
-std::pair<std::vector<Fill>, std::unique_ptr<Order>> 
-MatchingEngine::match_against_book(std::unique_ptr<Order> incoming_order, Book& opposite_book, Handles& handles, const Symb& symbol) {
-    static std::atomic<uint64_t> match_sequence{1000};
-    std::vector<Fill> fills;
-    bool incoming_fully_filled = false;
-    
-    auto it = opposite_book.begin();
-    while (it != opposite_book.end()) {
-        auto& resting_order = *it;
-        
-        bool can_match_orders = std::visit(
-            [this](const auto& incoming, const auto& resting) -> bool {
-                return can_match(Order(incoming), Order(resting));
-            }, 
-            *incoming_order, 
-            *resting_order);
-        
-        if (!can_match_orders) break;
-        
-        auto incoming = std::visit([](auto& ord) { return &ord.meta; }, *incoming_order);
-        auto resting = std::visit([](auto& ord) { return &ord.meta; }, *resting_order);
+RequestOutcome MatchingEngine::park_stop_order(std::unique_ptr<Order> order_ptr, OrderBook& book) {
+    auto meta = std::visit([](const auto& ord) { return ord.meta; }, *order_ptr);
+    Px stop_price = std::visit([](const auto& ord) -> Px {
+        if constexpr (requires { ord.stop_price; }) return ord.stop_price;
+        else return 0.0;
+    }, *order_ptr);
 
-        if (incoming->remaining_quantity == 0) break;
+    if (stop_price <= 0.0) {
+        RequestOutcome outcome;
+        outcome.status = RequestStatus::REJECTED;
+        outcome.reason = RejectReason::INVALID_PRICE;
+        outcome.message = "Stop order requires a positive stop price";
+        return outcome;
+    }
+
+    // Already through the trigger: fire straight away instead of parking
+    if (book.phase_ == TradingPhase::CONTINUOUS && book.last_trade_price_ && stop_triggered(meta.side, stop_price, *book.last_trade_price_)) {
+        trigger_stop(*order_ptr, book.now_);
+        return route_order(book, std::move(order_ptr));
+    }
+
+    OrderLog order_log;
+    order_log.symbol = book.symbol_;
+    order_log.seq = get_next_order_sequence(book);
+    order_log.ts = book.now_;
+    order_log.type = OrderEventType::NEW_ACCEPTED;
+    order_log.order_id = meta.order_id;
+    order_log.side = meta.side;
+    order_log.price = meta.price;
+    order_log.remaining_qty = meta.remaining_quantity;
+    order_logger_(order_log);
+
+    book.stop_handles_[meta.order_id] = StopHandle{meta.side, stop_price};
+    link_client_stop(book, meta);
+    note_order_added(book, meta);
+    schedule_expiry(book, meta);
+    if (meta.side == Side::BUY) {
+        book.buy_stops_.emplace(stop_price, std::move(order_ptr));
+    } else {
+        book.sell_stops_.emplace(stop_price, std::move(order_ptr));
+    }
+
+    RequestOutcome outcome;
+    outcome.status = RequestStatus::OK;
+    outcome.taker_remaining_qty = meta.remaining_quantity;
+    outcome.message = "Stop order accepted";
+    return outcome;
+}
+
+namespace {
+    template<class Stops>
+    auto find_stop(Stops& stops, Px stop_price, OrdId order_id) {
+        auto [first, last] = stops.equal_range(stop_price);
+        for (auto it = first; it != last; ++it) {
+            OrdId id = std::visit([](const auto& ord) { return ord.meta.order_id; }, *it->second);
+            if (id == order_id) return it;
+        }
+        return stops.end();
+    }
+
+    template<class Stops>
+    std::unique_ptr<Order> take_stop(Stops& stops, Px stop_price, OrdId order_id) {
+        auto it = find_stop(stops, stop_price, order_id);
+        if (it == stops.end()) return nullptr;
+        auto order = std::move(it->second);
+        stops.erase(it);
+        return order;
+    }
+}
+
+std::unique_ptr<Order> MatchingEngine::take_pending_stop(OrderBook& book, OrdId orderId) {
+    auto stopIt = book.stop_handles_.find(orderId);
+    if (stopIt == book.stop_handles_.end()) return nullptr;
+
+    StopHandle handle = stopIt->second;
+    auto order = (handle.side == Side::BUY)
+        ? take_stop(book.buy_stops_, handle.stop_price, orderId)
+        : take_stop(book.sell_stops_, handle.stop_price, orderId);
+    if (order) {
+        const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, *order);
+        note_order_removed(book, meta);
+        unlink_client_stop(book, meta);
+    }
+    book.stop_handles_.erase(orderId);
+    return order;
+}
+
+bool MatchingEngine::owned_by(const OrderBook& book, OrdId orderId, const ClientId& client) const {
+    const Order* order = nullptr;
+    if (auto handleIt = book.order_handles_.find(orderId); handleIt != book.order_handles_.end()) {
+        const auto& bookSide = (handleIt->second.side == Side::BUY) ? book.bids_ : book.asks_;
+        if (handleIt->second.vectorIndex < bookSide.size()) order = bookSide[handleIt->second.vectorIndex].get();
+    } else if (auto stopIt = book.stop_handles_.find(orderId); stopIt != book.stop_handles_.end()) {
+        const StopHandle& handle = stopIt->second;
+        if (handle.side == Side::BUY) {
+            auto it = find_stop(book.buy_stops_, handle.stop_price, orderId);
+            if (it != book.buy_stops_.end()) order = it->second.get();
+        } else {
+            auto it = find_stop(book.sell_stops_, handle.stop_price, orderId);
+            if (it != book.sell_stops_.end()) order = it->second.get();
+        }
+    }
+    return order && std::visit([](const auto& ord) -> const ClientId& { return ord.meta.client_id; }, *order) == client;
+}
+
+RequestOutcome MatchingEngine::cancel_stop_order(OrderBook& book, OrdId orderId) {
+    auto order = take_pending_stop(book, orderId);
+
+    if (!order) {
+        RequestOutcome outcome;
+        outcome.status = RequestStatus::REJECTED;
+        outcome.reason = RejectReason::UNKNOWN_ORDER;
+        outcome.message = "Stop order not found in trigger index";
+        return outcome;
+    }
+
+    auto order_meta = std::visit([](auto& ord) {
+        ord.meta.state = OrdState::CANCELLED;
+        return ord.meta;
+    }, *order);
+
+    OrderLog order_log;
+    order_log.symbol = book.symbol_;
+    order_log.seq = get_next_order_sequence(book);
+    order_log.ts = book.now_;
+    order_log.type = OrderEventType::CANCELED;
+    order_log.order_id = order_meta.order_id;
+    order_log.side = order_meta.side;
+    order_log.price = order_meta.price;
+    order_log.remaining_qty = order_meta.remaining_quantity;
+    order_logger_(order_log);
+
+    RequestOutcome outcome;
+    outcome.status = RequestStatus::OK;
+    outcome.message = "Stop order cancelled successfully";
+    return outcome;
+}
+
+void MatchingEngine::run_stop_triggers(OrderBook& book) {
+    // Each pass pops every stop the last trade has crossed - buy side first,
+    // each side in trigger price then arrival order. Fills from fired orders
+    // can move the price again, so keep passing until nothing more triggers.
+    std::vector<std::unique_ptr<Order>> fired;
+    while (book.phase_ == TradingPhase::CONTINUOUS && book.last_trade_price_) {
+        Px last_price = *book.last_trade_price_;
+
+        auto buy_end = book.buy_stops_.upper_bound(last_price);
+        for (auto it = book.buy_stops_.begin(); it != buy_end; ++it) {
+            fired.push_back(std::move(it->second));
+        }
+        book.buy_stops_.erase(book.buy_stops_.begin(), buy_end);
+
+        auto sell_end = book.sell_stops_.upper_bound(last_price);
+        for (auto it = book.sell_stops_.begin(); it != sell_end; ++it) {
+            fired.push_back(std::move(it->second));
+        }
+        book.sell_stops_.erase(book.sell_stops_.begin(), sell_end);
+
+        if (fired.empty()) break;
+
+        for (auto& order : fired) {
+            auto meta = std::visit([](const auto& ord) { return ord.meta; }, *order);
+            note_order_removed(book, meta);
+            unlink_client_stop(book, meta);
+            book.stop_handles_.erase(meta.order_id);
+            trigger_stop(*order, book.now_);
+            // Accepted when it parked; journal the firing instead of a
+            // second NEW_ACCEPTED, at the price it now carries
+            Px fired_price = std::visit([](const auto& ord) { return ord.meta.price; }, *order);
+            OrderLog trigger_log{
+                .symbol = book.symbol_,
+                .seq = get_next_order_sequence(book),
+                .ts = book.now_,
+                .type = OrderEventType::TRIGGERED,
+                .order_id = meta.order_id,
+                .side = meta.side,
+                .price = fired_price,
+                .remaining_qty = meta.remaining_quantity
+            };
+            order_logger_(trigger_log);
+            auto outcome = route_order(book, std::move(order), true);
+            if (outcome.status != RequestStatus::REJECTED) continue;
+
+            // No submitter is waiting on a triggered stop, so a market order
+            // that found too little liquidity is reported here: rejected if
+            // nothing filled, otherwise its unfilled remainder is cancelled
+            OrderLog order_log{
+                .symbol = book.symbol_,
+                .seq = get_next_order_sequence(book),
+                .ts = book.now_,
+                .type = outcome.taker_filled_qty ? OrderEventType::CANCELED : OrderEventType::REJECTED,
+                .order_id = meta.order_id,
+                .side = meta.side,
+                .price = meta.price,
+                .remaining_qty = outcome.taker_filled_qty ? outcome.taker_remaining_qty : meta.remaining_quantity,
+                .reason = outcome.reason
+            };
+            order_logger_(order_log);
+        }
+        fired.clear();
+    }
+}
+
+void MatchingEngine::trigger_stop(Order& order, Timestamp ts) {
+    // Swap the stop for its triggered type in the same storage; priority
+    // starts from the trigger, not from when the stop was entered
+    std::visit([&order, ts](auto& ord) {
+        if constexpr (requires { ord.triggered(); }) {
+            auto fired = ord.triggered();
+            fired.meta.timestamp = ts;
+            order = std::move(fired);
+        }
+    }, order);
+}
+
+bool MatchingEngine::stop_triggered(Side side, Px stop_price, Px last_price) {
+    return (side == Side::BUY) ? last_price >= stop_price : last_price <= stop_price;
+}
+
+RequestOutcome MatchingEngine::change_phase(OrderBook& book, TradingPhase phase) {
+    if (book.phase_ == phase) {
+        RequestOutcome outcome;
+        outcome.status = RequestStatus::NOOP;
+        outcome.message = "Trading phase unchanged";
+        return outcome;
+    }
+
+    RequestOutcome outcome;
+    outcome.status = RequestStatus::OK;
+    outcome.message = "Trading phase changed";
+    if (book.phase_ == TradingPhase::CALL_AUCTION) {
+        outcome = uncross(book);
+    }
+    book.phase_ = phase;
+
+    // Stops crossed by the auction price fire once continuous trading resumes
+    run_stop_triggers(book);
+    return outcome;
+}
+
+RequestOutcome MatchingEngine::accept_in_auction(OrderBook& book, std::unique_ptr<Order> order) {
+    RequestOutcome outcome;
+    if (book.phase_ == TradingPhase::CLOSED) {
+        outcome.status = RequestStatus::REJECTED;
+        outcome.reason = RejectReason::BOOK_CLOSED;
+        outcome.message = "Book is closed";
+        return outcome;
+    }
+
+    // Call phase: limit interest rests (even if crossed), stops park, and
+    // market orders have no price to take part in the uncross with
+    bool is_market = std::holds_alternative<MarketOrder>(*order);
+    bool is_stop = std::holds_alternative<StopOrder>(*order) || std::holds_alternative<StopLimitOrder>(*order);
+    if (is_market) {
+        outcome.status = RequestStatus::REJECTED;
+        outcome.reason = RejectReason::BOOK_CLOSED;
+        outcome.message = "Market orders are not accepted during the call phase";
+        return outcome;
+    }
+    if (is_stop) {
+        return park_stop_order(std::move(order), book);
+    }
+
+    Qty open_qty = open_quantity(*order);
+    std::visit([](auto& ord) {
+        if constexpr (requires { ord.hide_reserve(); }) ord.hide_reserve();
+    }, *order);
+    insert_sorted(std::move(order), book);
+
+    outcome.status = RequestStatus::OK;
+    outcome.taker_remaining_qty = open_qty;
+    outcome.message = "Order queued for auction";
+    return outcome;
+}
+
+RequestOutcome MatchingEngine::uncross(OrderBook& book) {
+    struct Level { Px price; uint64_t qty; };
+    auto aggregate = [](const Book& book_side) {
+        std::vector<Level> levels;
+        for (const auto& order : book_side) {
+            Px price = std::visit([](const auto& ord) { return ord.meta.price; }, *order);
+            if (levels.empty() || levels.back().price != price) levels.push_back(Level{price, 0});
+            levels.back().qty += open_quantity(*order);
+        }
+        return levels;
+    };
+    auto bid_levels = aggregate(book.bids_);  // descending
+    auto ask_levels = aggregate(book.asks_);  // ascending
+
+    RequestOutcome outcome;
+    outcome.status = RequestStatus::OK;
+    if (bid_levels.empty() || ask_levels.empty() || bid_levels.front().price < ask_levels.front().price) {
+        outcome.message = "Auction closed without a cross";
+        return outcome;
+    }
+
+    // Candidate prices are the level prices inside [best ask, best bid]
+    Px lo = ask_levels.front().price;
+    Px hi = bid_levels.front().price;
+    std::vector<Px> prices;
+    for (auto level = bid_levels.rbegin(); level != bid_levels.rend(); ++level) {
+        if (level->price <= hi && level->price >= lo) prices.push_back(level->price);
+    }
+    size_t bid_count = prices.size();
+    for (const auto& level : ask_levels) {
+        if (level.price <= hi && level.price >= lo) prices.push_back(level.price);
+    }
+    std::inplace_merge(prices.begin(), prices.begin() + bid_count, prices.end());
+    prices.erase(std::unique(prices.begin(), prices.end()), prices.end());
+
+    // Cumulative supply (asks at or below p) and demand (bids at or above p)
+    size_t n = prices.size();
+    std::vector<uint64_t> supply(n), demand(n);
+    uint64_t cumulative = 0;
+    for (size_t i = 0, a = 0; i < n; ++i) {
+        while (a < ask_levels.size() && ask_levels[a].price <= prices[i]) cumulative += ask_levels[a++].qty;
+        supply[i] = cumulative;
+    }
+    cumulative = 0;
+    for (size_t i = n, b = 0; i-- > 0;) {
+        while (b < bid_levels.size() && bid_levels[b].price >= prices[i]) cumulative += bid_levels[b++].qty;
+        demand[i] = cumulative;
+    }
+
+    // Maximum volume, then minimum imbalance, then closest to the last trade,
+    // then the lower price
+    size_t best = 0;
+    auto volume = [&](size_t i) { return std::min(supply[i], demand[i]); };
+    auto imbalance = [&](size_t i) { return supply[i] > demand[i] ? supply[i] - demand[i] : demand[i] - supply[i]; };
+    auto distance = [&](size_t i) { return book.last_trade_price_ ? std::abs(prices[i] - *book.last_trade_price_) : 0.0; };
+    for (size_t i = 1; i < n; ++i) {
+        if (volume(i) != volume(best)) {
+            if (volume(i) > volume(best)) best = i;
+        } else if (imbalance(i) != imbalance(best)) {
+            if (imbalance(i) < imbalance(best)) best = i;
+        } else if (distance(i) < distance(best)) {
+            best = i;
+        }
+    }
+    Px cross_price = prices[best];
+    uint64_t cross_volume = volume(best);
+
+    // Execute in bulk: pair bids and asks front to back at the single cross
+    // price; the later arrival of each pair is reported as the taker
+    Timestamp ts = book.now_;
+    size_t bi = 0, ai = 0;
+    uint64_t left = cross_volume;
+    std::vector<Fill> fills;
+    while (left > 0) {
+        Order& bid = *book.bids_[bi];
+        Order& ask = *book.asks_[ai];
+        auto& bid_meta = std::visit([](auto& ord) -> OrderMeta& { return ord.meta; }, bid);
+        auto& ask_meta = std::visit([](auto& ord) -> OrderMeta& { return ord.meta; }, ask);
+        Qty qty = static_cast<Qty>(std::min<uint64_t>({open_quantity(bid), open_quantity(ask), left}));
+        bool buy_is_taker = ask_meta.timestamp < bid_meta.timestamp;
 
-        // Create fill using new Fill struct
         Fill fill{
-            .symbol = symbol,
-            .taker_id = incoming->order_id,
-            .maker_id = resting->order_id,
-            .price = resting->price,
-            .qty = std::min(incoming->remaining_quantity, resting->remaining_quantity),
-            .taker_is_buy = (incoming->side == Side::BUY),
-            .ts = std::chrono::steady_clock::now(),
-            .match_seq = ++match_sequence
+            .symbol = book.symbol_,
+            .taker_id = buy_is_taker ? bid_meta.order_id : ask_meta.order_id,
+            .maker_id = buy_is_taker ? ask_meta.order_id : bid_meta.order_id,
+            .price = cross_price,
+            .qty = qty,
+            .taker_is_buy = buy_is_taker,
+            .ts = ts,
+            .match_seq = ++book.match_seq_
         };
         fills.emplace_back(fill);
-        
-        // Generate TradeLog event
+
         TradeLog trade_log{
-            .symbol = symbol,
-            .seq = get_next_trade_sequence(symbol),
-            .ts = fill.ts,
-            .fill = fill
+            .symbol = book.symbol_,
+            .seq = get_next_trade_sequence(book),
+            .ts = ts,
+            .fill = fill,
+            .taker_client = buy_is_taker ? bid_meta.client_id : ask_meta.client_id,
+            .maker_client = buy_is_taker ? ask_meta.client_id : bid_meta.client_id
         };
         trade_logger_(trade_log);
-        
-        // Update quantities
-        incoming->remaining_quantity -= fill.qty;
-        resting->remaining_quantity -= fill.qty;
-        
-        // Generate OrderLog events for resting order
-        OrderLog resting_log{
-            .symbol = symbol,
-            .seq = get_next_order_sequence(symbol),
-            .ts = fill.ts,
-            .order_id = resting->order_id,
-            .side = resting->side,
-            .price = resting->price,
-            .remaining_qty = resting->remaining_quantity
-        };
-        // Check if resting order is fully filled
-        if (resting->remaining_quantity == 0) {
-            resting->state = OrdState::FILLED;
-            resting_log.type = OrderEventType::FILLED;
-            order_logger_(resting_log);
-            
-            handles.erase(resting->order_id);
-            it = opposite_book.erase(it);
-            update_handles_after_removal(resting->side, std::distance(opposite_book.begin(), it), opposite_book, handles);
-        } else {
-            resting->state = OrdState::PARTIALLY_FILLED;
-            resting_log.type = OrderEventType::PARTIALLY_FILLED;
-            order_logger_(resting_log);
-            ++it;
+        note_fill(bid_meta, ask_meta, qty);
+
+        for (Order* filled : {&bid, &ask}) {
+            auto& meta = std::visit([](auto& ord) -> OrderMeta& { return ord.meta; }, *filled);
+            Qty before = meta.remaining_quantity;
+            consume(*filled, qty);
+            note_quantity_change(book, meta, before);
+            bool done = open_quantity(*filled) == 0;
+            meta.state = done ? OrdState::FILLED : OrdState::PARTIALLY_FILLED;
+            OrderLog order_log{
+                .symbol = book.symbol_,
+                .seq = get_next_order_sequence(book),
+                .ts = ts,
+                .type = done ? OrderEventType::FILLED : OrderEventType::PARTIALLY_FILLED,
+                .order_id = meta.order_id,
+                .side = meta.side,
+                .price = meta.price,
+                .remaining_qty = meta.remaining_quantity
+            };
+            order_logger_(order_log);
         }
-        
-        // Generate OrderLog event for incoming order
-        OrderLog incoming_log{
-            .symbol = symbol,
-            .seq = get_next_order_sequence(symbol),
-            .ts = fill.ts,
-            .order_id = incoming->order_id,
-            .side = incoming->side,
-            .price = incoming->price,
-            .remaining_qty = incoming->remaining_quantity
-        };
-        
-        if (incoming->remaining_quantity == 0) {
-            incoming->state = OrdState::FILLED;
-            incoming_log.type = OrderEventType::FILLED;
-            incoming_fully_filled = true;
-        } else {
-            incoming->state = OrdState::PARTIALLY_FILLED;
-            incoming_log.type = OrderEventType::PARTIALLY_FILLED;
+
+        if (open_quantity(bid) == 0) ++bi;
+        if (open_quantity(ask) == 0) ++ai;
+        left -= qty;
+    }
+
+    // Fully filled orders form a prefix of each side: drop them in one go
+    erase_filled_prefix(book, book.bids_, bi);
+    erase_filled_prefix(book, book.asks_, ai);
+    book.last_trade_price_ = cross_price;
+
+    outcome.taker_filled_qty = static_cast<Qty>(cross_volume);
+    outcome.fills = std::move(fills);
+    outcome.message = "Auction uncrossed";
+    return outcome;
+}
+
+std::pair<std::vector<Fill>, std::unique_ptr<Order>> 
+MatchingEngine::match_against_book(std::unique_ptr<Order> incoming_order, Book& opposite_book, OrderBook& book) {
+    using Matcher = std::pair<std::vector<Fill>, std::unique_ptr<Order>> (MatchingEngine::*)(std::unique_ptr<Order>, Book&, OrderBook&);
+    // Indexed by MatchingPolicy
+    static constexpr Matcher kMatchers[] = {
+        &MatchingEngine::match_with<FifoAllocation>,
+        &MatchingEngine::match_with<ProRataAllocation>,
+        &MatchingEngine::match_with<HybridAllocation>
+    };
+    static_assert(FifoAllocation::kPolicy == MatchingPolicy::FIFO && ProRataAllocation::kPolicy == MatchingPolicy::PRO_RATA &&
+                  HybridAllocation::kPolicy == MatchingPolicy::HYBRID);
+    tracing::Span span("match_against_book");
+    return (this->*kMatchers[static_cast<size_t>(book.allocation_.policy)])(std::move(incoming_order), opposite_book, book);
+}
+
+template<class Policy>
+std::pair<std::vector<Fill>, std::unique_ptr<Order>> 
+MatchingEngine::match_with(std::unique_ptr<Order> incoming_order, Book& opposite_book, OrderBook& book) {
+    std::vector<Fill> fills;
+    auto incoming = std::visit([](auto& ord) { return &ord.meta; }, *incoming_order);
+    // Orders of the current level still to be swept FIFO before it is looked at again
+    [[maybe_unused]] size_t sweep = 0;
+
+    auto it = opposite_book.begin();
+    while (it != opposite_book.end()) {
+        if (!can_match(*incoming_order, **it)) break;
+        if (incoming->remaining_quantity == 0) break;
+
+        if constexpr (Policy::kLevelAllocation) {
+            if (sweep == 0) {
+                // Visible quantities of the level, in time order
+                thread_local std::vector<Qty> residual;
+                thread_local std::vector<Qty> allocated;
+                Px price = std::visit([](const auto& ord) { return ord.meta.price; }, **it);
+                residual.clear();
+                uint64_t total = 0;
+                for (auto level = it; level != opposite_book.end(); ++level) {
+                    const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, **level);
+                    if (meta.price != price) break;
+                    residual.push_back(meta.remaining_quantity);
+                    total += meta.remaining_quantity;
+                }
+
+                if (incoming->remaining_quantity >= total) {
+                    // Takes the whole level: nothing to allocate
+                    sweep = residual.size();
+                } else {
+                    OrdId front = std::visit([](const auto& ord) { return ord.meta.order_id; }, **it);
+                    bool top_order = front == (incoming->side == Side::BUY ? book.top_ask_ : book.top_bid_);
+                    allocated.assign(residual.size(), 0);
+                    Policy::allocate(book.allocation_, top_order, incoming->remaining_quantity,
+                                     residual.data(), allocated.data(), residual.size());
+                    // Apply in time order; each order is visited once however
+                    // execute_fill moves it
+                    for (Qty qty : allocated) {
+                        it = qty > 0 ? execute_fill(*incoming, it, qty, opposite_book, book, fills) : std::next(it);
+                    }
+                    break;
+                }
+            }
+            --sweep;
         }
-        order_logger_(incoming_log);
+
+        auto resting = std::visit([](auto& ord) { return &ord.meta; }, **it);
+        it = execute_fill(*incoming, it, std::min(incoming->remaining_quantity, resting->remaining_quantity),
+                          opposite_book, book, fills);
     }
 
+    bool incoming_fully_filled = !fills.empty() && incoming->remaining_quantity == 0;
     // Return both fills and remaining order (or nullptr if fully filled)
-    return {std::move(fills), incoming_fully_filled ? std::move(incoming_order) : nullptr};
+    return {std::move(fills), incoming_fully_filled ? nullptr : std::move(incoming_order)};
 }
 
-void MatchingEngine::insert_sorted(std::unique_ptr<Order> order, OrderBook& book) {
+Book::iterator MatchingEngine::execute_fill(OrderMeta& incoming_meta, Book::iterator it, Qty qty, Book& opposite_book,
+                                            OrderBook& book, std::vector<Fill>& fills) {
+    Handles& handles = book.order_handles_;
+    const Symb& symbol = book.symbol_;
+    auto& resting_order = *it;
+    auto incoming = &incoming_meta;
+    auto resting = std::visit([](auto& ord) { return &ord.meta; }, *resting_order);
+
+    // Create fill using new Fill struct
+    Fill fill{
+        .symbol = symbol,
+        .taker_id = incoming->order_id,
+        .maker_id = resting->order_id,
+        .price = resting->price,
+        .qty = qty,
+        .taker_is_buy = (incoming->side == Side::BUY),
+        .ts = book.now_,
+        .match_seq = ++book.match_seq_
+    };
+    fills.emplace_back(fill);
+    
+    // Generate TradeLog event
+    TradeLog trade_log{
+        .symbol = symbol,
+        .seq = get_next_trade_sequence(book),
+        .ts = fill.ts,
+        .fill = fill,
+        .taker_client = incoming->client_id,
+        .maker_client = resting->client_id
+    };
+    trade_logger_(trade_log);
+    
+    // Update quantities
+    incoming->remaining_quantity -= fill.qty;
+    resting->remaining_quantity -= fill.qty;
+    note_fill(*incoming, *resting, fill.qty);
+    note_quantity_change(book, *resting, resting->remaining_quantity + fill.qty);
+    
+    // Generate OrderLog events for resting order
+    OrderLog resting_log{
+        .symbol = symbol,
+        .seq = get_next_order_sequence(book),
+        .ts = fill.ts,
+        .order_id = resting->order_id,
+        .side = resting->side,
+        .price = resting->price,
+        .remaining_qty = resting->remaining_quantity
+    };
+    // An exhausted iceberg slice refills from its reserve and goes to the
+    // back of its level; the order object and its handle entry are reused
+    Qty replenished = 0;
+    if (resting->remaining_quantity == 0) {
+        replenished = std::visit([](auto& ord) -> Qty {
+            if constexpr (requires { ord.replenish(); }) return ord.replenish();
+            else return 0;
+        }, *resting_order);
+    }
+
+    // Check if resting order is fully filled
+    if (replenished > 0) {
+        note_quantity_change(book, *resting, 0);
+        resting->state = OrdState::PARTIALLY_FILLED;
+        resting->timestamp = book.now_;
+        resting_log.type = OrderEventType::PARTIALLY_FILLED;
+        resting_log.remaining_qty = replenished;
+        order_logger_(resting_log);
+
+        it = requeue_at_level_back(it, opposite_book, handles);
+    } else if (resting->remaining_quantity == 0) {
+        resting->state = OrdState::FILLED;
+        resting_log.type = OrderEventType::FILLED;
+        order_logger_(resting_log);
+        
+        note_order_removed(book, *resting);
+        unlink_client_order(book, *resting);
+        handles.erase(resting->order_id);
+        it = opposite_book.erase(it);
+        update_handles_after_removal(std::distance(opposite_book.begin(), it), opposite_book, handles);
+    } else {
+        resting->state = OrdState::PARTIALLY_FILLED;
+        resting_log.type = OrderEventType::PARTIALLY_FILLED;
+        order_logger_(resting_log);
+        ++it;
+    }
+    
+    // Generate OrderLog event for incoming order
+    OrderLog incoming_log{
+        .symbol = symbol,
+        .seq = get_next_order_sequence(book),
+        .ts = fill.ts,
+        .order_id = incoming->order_id,
+        .side = incoming->side,
+        .price = incoming->price,
+        .remaining_qty = incoming->remaining_quantity
+    };
+    
+    if (incoming->remaining_quantity == 0) {
+        incoming->state = OrdState::FILLED;
+        incoming_log.type = OrderEventType::FILLED;
+    } else {
+        incoming->state = OrdState::PARTIALLY_FILLED;
+        incoming_log.type = OrderEventType::PARTIALLY_FILLED;
+    }
+    order_logger_(incoming_log);
+    return it;
+}
+
+void MatchingEngine::insert_sorted(std::unique_ptr<Order> order, OrderBook& book, bool announce) {
     auto meta = std::visit([](const auto& ord) { return ord.meta; }, *order);
     auto& book_side = (meta.side == Side::BUY) ? book.bids_ : book.asks_;
     auto comparator = (meta.side == Side::BUY) ? bid_comparator : ask_comparator;
 
-    auto insert_pos = std::lower_bound(book_side.begin(), book_side.end(), order, comparator);
+    // Orders stamped on the same tick keep arrival order
+    auto insert_pos = std::upper_bound(book_side.begin(), book_side.end(), order,
+        [comparator](const std::unique_ptr<Order>& a, const std::unique_ptr<Order>& b) {
+            return comparator(*a, *b);
+        });
     size_t insert_index = std::distance(book_side.begin(), insert_pos);
+    // Ahead of every resting order means it opened a new best level
+    if (insert_index == 0) {
+        (meta.side == Side::BUY ? book.top_bid_ : book.top_ask_) = meta.order_id;
+    }
  
     // Create and store the handle
     OrderHandle handle;
     handle.side = meta.side;
     handle.vectorIndex = insert_index;
     book.order_handles_[meta.order_id] = handle;
-    
-    // Update indices for orders after insertion point
-    for (size_t i = insert_index + 1; i < book_side.size(); ++i) {
-        OrdId id = std::visit([](const auto& ord) { return ord.meta.order_id; }, *book_side[i]);
-        book.order_handles_[id].vectorIndex = i;
-    }
+    link_client_order(book, meta);
+    note_order_added(book, meta);
+    schedule_expiry(book, meta);
 
     // Generate OrderLog event for NEW_ACCEPTED
-    OrderLog order_log;
-    order_log.symbol = book.symbol_;
-    order_log.seq = get_next_order_sequence(book.symbol_);
-    order_log.ts = std::chrono::steady_clock::now();
-    order_log.type = OrderEventType::NEW_ACCEPTED;
-    order_log.order_id = meta.order_id;
-    order_log.side = meta.side;
-    order_log.price = meta.price;
-    order_log.remaining_qty = meta.remaining_quantity;
-    order_logger_(order_log);
+    if (announce) {
+        OrderLog order_log;
+        order_log.symbol = book.symbol_;
+        order_log.seq = get_next_order_sequence(book);
+        order_log.ts = book.now_;
+        order_log.type = OrderEventType::NEW_ACCEPTED;
+        order_log.order_id = meta.order_id;
+        order_log.side = meta.side;
+        order_log.price = meta.price;
+        order_log.remaining_qty = meta.remaining_quantity;
+        order_logger_(order_log);
+    }
 
     // Insert the order into the book
     book_side.insert(insert_pos, std::move(order));
+
+    // Update indices for orders after insertion point
+    for (size_t i = insert_index + 1; i < book_side.size(); ++i) {
+        OrdId id = std::visit([](const auto& ord) { return ord.meta.order_id; }, *book_side[i]);
+        book.order_handles_[id].vectorIndex = i;
+    }
 }
 
-void MatchingEngine::remove_from_book(OrdId order_id, OrderBook& book) {
+std::unique_ptr<Order> MatchingEngine::remove_from_book(OrdId order_id, OrderBook& book) {
     auto& handles = book.order_handles_;
     
     auto handle_it = handles.find(order_id);
     if (handle_it == handles.end()) {
-        return;
+        return nullptr;
     }
     
     const OrderHandle& handle = handle_it->second;
     auto& book_side = (handle.side == Side::BUY) ? book.bids_ : book.asks_;
     
+    std::unique_ptr<Order> removed;
     if (handle.vectorIndex < book_side.size()) {
+        removed = std::move(book_side[handle.vectorIndex]);
+        const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, *removed);
+        note_order_removed(book, meta);
+        unlink_client_order(book, meta);
         book_side.erase(book_side.begin() + handle.vectorIndex);
-        update_handles_after_removal(handle.side, handle.vectorIndex, book_side, handles);
+        update_handles_after_removal(handle.vectorIndex, book_side, handles);
         handles.erase(handle_it);
     }
+    return removed;
 }
 
-void MatchingEngine::update_handles_after_removal(Side side, size_t removed_index, Book& book_side, Handles& handles) {
+void MatchingEngine::update_handles_after_removal(size_t removed_index, Book& book_side, Handles& handles) {
     for (size_t i = removed_index; i < book_side.size(); ++i) {
         OrdId id = std::visit([](const auto& ord) { return ord.meta.order_id; }, *book_side[i]);
         handles[id].vectorIndex = i;
     }
 }
 
+Book::iterator MatchingEngine::requeue_at_level_back(Book::iterator it, Book& book_side, Handles& handles) {
+    // Rotate the order behind the rest of its price level; only the handles
+    // inside that level shift. Returns the new occupant of the old slot.
+    Px price = std::visit([](const auto& ord) { return ord.meta.price; }, **it);
+    auto level_end = std::find_if(std::next(it), book_side.end(), [price](const std::unique_ptr<Order>& o) {
+        return std::visit([](const auto& ord) { return ord.meta.price; }, *o) != price;
+    });
+    size_t first = std::distance(book_side.begin(), it);
+    size_t last = std::distance(book_side.begin(), level_end);
+    std::rotate(it, std::next(it), level_end);
+    for (size_t i = first; i < last; ++i) {
+        OrdId id = std::visit([](const auto& ord) { return ord.meta.order_id; }, *book_side[i]);
+        handles[id].vectorIndex = i;
+    }
+    return book_side.begin() + first;
+}
+
+void MatchingEngine::expire_orders(OrderBook& book, Timestamp now) {
+    book.now_ = std::max(book.now_, now);
+    if (book.replaying_) {
+        // The primary's wheel decided; see OrderBook::expired_
+        for (OrdId id : book.expired_) remove_expired(book, id);
+        return;
+    }
+    book.expired_.clear();
+    book.expiries_.advance(OrderBook::expiry_tick(now), [this, &book](OrdId id, TimingWheel::Tick deadline) {
+        if (expire_order(book, id, deadline)) book.expired_.push_back(id);
+    });
+}
+
+void MatchingEngine::schedule_expiry(OrderBook& book, const OrderMeta& meta) {
+    if (meta.expires()) {
+        book.expiries_.schedule(meta.order_id, OrderBook::expiry_tick(meta.expire_at));
+    }
+}
+
+bool MatchingEngine::expire_order(OrderBook& book, OrdId order_id, TimingWheel::Tick deadline) {
+    // Wheel entries are not removed on fill/cancel/replace: only act if the
+    // order is still live with the deadline this entry was scheduled for.
+    // Pending stops cannot be modified, so a live one is always due.
+    if (auto handle_it = book.order_handles_.find(order_id); handle_it != book.order_handles_.end()) {
+        auto& book_side = (handle_it->second.side == Side::BUY) ? book.bids_ : book.asks_;
+        const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; },
+                                      *book_side[handle_it->second.vectorIndex]);
+        if (!meta.expires() || OrderBook::expiry_tick(meta.expire_at) != deadline) return false;
+    }
+    return remove_expired(book, order_id);
+}
+
+bool MatchingEngine::remove_expired(OrderBook& book, OrdId order_id) {
+    std::unique_ptr<Order> expired = book.order_handles_.count(order_id)
+        ? remove_from_book(order_id, book)
+        : take_pending_stop(book, order_id);
+    if (!expired) return false;
+
+    auto meta = std::visit([](auto& ord) {
+        ord.meta.state = OrdState::CANCELLED;
+        return ord.meta;
+    }, *expired);
+
+    OrderLog order_log{
+        .symbol = book.symbol_,
+        .seq = get_next_order_sequence(book),
+        .ts = book.now_,
+        .type = OrderEventType::EXPIRED,
+        .order_id = meta.order_id,
+        .side = meta.side,
+        .price = meta.price,
+        .remaining_qty = meta.remaining_quantity
+    };
+    order_logger_(order_log);
+    return true;
+}
+
+L2Snapshot MatchingEngine::snapshot_l2(const OrderBook& book, size_t depth) const {
+    auto aggregate = [depth](const Book& book_side) {
+        std::vector<PriceLevel> levels;
+        for (const auto& order : book_side) {
+            const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, *order);
+            if (levels.empty() || levels.back().price != meta.price) {
+                if (levels.size() == depth) break;
+                levels.push_back(PriceLevel{meta.price, 0, 0});
+            }
+            levels.back().quantity += meta.remaining_quantity;
+            ++levels.back().order_count;
+        }
+        return levels;
+    };
+
+    L2Snapshot snapshot;
+    snapshot.symbol = book.symbol_;
+    snapshot.bids = aggregate(book.bids_);
+    snapshot.asks = aggregate(book.asks_);
+    snapshot.checksum = book.checksum_;
+    return snapshot;
+}
+
+ChecksumLog MatchingEngine::checksum_log(const OrderBook& book, Timestamp ts) const {
+    return ChecksumLog{
+        .symbol = book.symbol_,
+        .seq = book.order_seq_,
+        .ts = ts,
+        .checksum = book.checksum_
+    };
+}
+
+void MatchingEngine::erase_filled_prefix(OrderBook& book, Book& book_side, size_t count) {
+    if (count == 0) return;
+    for (size_t i = 0; i < count; ++i) {
+        const auto& meta = std::visit([](const auto& ord) -> const OrderMeta& { return ord.meta; }, *book_side[i]);
+        note_order_removed(book, meta);
+        unlink_client_order(book, meta);
+        book.order_handles_.erase(meta.order_id);
+    }
+    book_side.erase(book_side.begin(), book_side.begin() + count);
+    reindex_handles(book_side, book.order_handles_);
+}
+
+void MatchingEngine::reindex_handles(Book& book_side, Handles& handles) {
+    for (size_t i = 0; i < book_side.size(); ++i) {
+        OrdId id = std::visit([](const auto& ord) { return ord.meta.order_id; }, *book_side[i]);
+        handles[id].vectorIndex = i;
+    }
+}
+
+void MatchingEngine::link_client_order(OrderBook& book, const OrderMeta& meta) {
+    link_client(book.client_orders_, book.order_handles_, meta.client_id, meta.order_id);
+}
+
+void MatchingEngine::unlink_client_order(OrderBook& book, const OrderMeta& meta) {
+    unlink_client(book.client_orders_, book.order_handles_, meta.client_id, meta.order_id);
+}
+
+void MatchingEngine::link_client_stop(OrderBook& book, const OrderMeta& meta) {
+    link_client(book.client_stops_, book.stop_handles_, meta.client_id, meta.order_id);
+}
+
+void MatchingEngine::unlink_client_stop(OrderBook& book, const OrderMeta& meta) {
+    unlink_client(book.client_stops_, book.stop_handles_, meta.client_id, meta.order_id);
+}
+
+void MatchingEngine::note_order_added(OrderBook& book, const OrderMeta& meta) {
+    book.checksum_ += OrderBook::order_hash(meta);
+    if (risk_manager_) risk_manager_->onOrderOpened(meta.client_id);
+}
+
+void MatchingEngine::note_order_removed(OrderBook& book, const OrderMeta& meta) {
+    book.checksum_ -= OrderBook::order_hash(meta);
+    if (risk_manager_) risk_manager_->onOrderClosed(meta.client_id);
+}
+
+void MatchingEngine::note_quantity_change(OrderBook& book, const OrderMeta& meta, Qty before) {
+    OrderMeta old = meta;
+    old.remaining_quantity = before;
+    book.checksum_ += OrderBook::order_hash(meta) - OrderBook::order_hash(old);
+}
+
+void MatchingEngine::note_fill(const OrderMeta& taker, const OrderMeta& maker, Qty qty) {
+    if (risk_manager_) {
+        risk_manager_->onFill(taker.client_id, taker.side, qty);
+        risk_manager_->onFill(maker.client_id, maker.side, qty);
+    }
+}
+
+RiskDecision MatchingEngine::check_risk(OrderBook& book, const OrderMeta& meta, Px ref_price, Qty qty, bool replacing) {
+    if (!book.replaying_) book.risk_verdict_ = risk_manager_->check(meta.client_id, meta.side, ref_price, qty, replacing);
+    return book.risk_verdict_.value_or(RiskDecision{});
+}
+
 bool MatchingEngine::can_match(const Order& incoming, const Order& resting) const {
     return std::visit([](const auto& inc, const auto& rest) -> bool {
         if (inc.meta.side == rest.meta.side) return false;
+        if constexpr (std::is_same_v<std::decay_t<decltype(inc)>, MarketOrder>) return true;
 
         if (inc.meta.side == Side::BUY) {
             return inc.meta.price >= rest.meta.price;
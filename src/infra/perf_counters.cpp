@@ -0,0 +1,108 @@
+#include "perf_counters.h"
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    struct EventSpec {
+        uint32_t type;
+        uint64_t config;
+    };
+
+    constexpr uint64_t cacheMiss(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    // Indexed by PerfEvent
+    constexpr std::array<EventSpec, kPerfEvents> kEvents{{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D)},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    }};
+
+    int openEvent(const EventSpec& spec, int groupFd) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+        attr.disabled = groupFd < 0;  // the leader starts the whole group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    struct GroupRead {
+        uint64_t nr;
+        struct {
+            uint64_t value;
+            uint64_t id;
+        } values[kPerfEvents];
+    };
+}
+
+PerfCounters::PerfCounters() {
+    fds_.fill(-1);
+    leader_ = openEvent(kEvents[0], -1);
+    if (leader_ < 0) return;
+    fds_[0] = leader_;
+    for (size_t i = 1; i < kPerfEvents; ++i) fds_[i] = openEvent(kEvents[i], leader_);
+    for (size_t i = 0; i < kPerfEvents; ++i) {
+        if (fds_[i] >= 0 && ::ioctl(fds_[i], PERF_EVENT_IOC_ID, &ids_[i]) < 0) {
+            ::close(fds_[i]);
+            fds_[i] = -1;
+        }
+    }
+    if (fds_[0] < 0) {
+        for (int fd : fds_) if (fd >= 0) ::close(fd);
+        fds_.fill(-1);
+        leader_ = -1;
+        return;
+    }
+    ::ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds_) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+bool PerfCounters::read(Reading& out) const {
+    if (leader_ < 0) return false;
+    GroupRead group;
+    ssize_t n = ::read(leader_, &group, sizeof(group));
+    if (n < static_cast<ssize_t>(sizeof(uint64_t))) return false;
+    out.fill(0);
+    for (uint64_t i = 0; i < group.nr && i < kPerfEvents; ++i) {
+        for (size_t e = 0; e < kPerfEvents; ++e) {
+            if (fds_[e] >= 0 && ids_[e] == group.values[i].id) out[e] = group.values[i].value;
+        }
+    }
+    return true;
+}
+
+void PerfCounters::record(size_t requestType, const Reading& before) {
+    Reading after;
+    if (requestType >= kRequestTypes || !read(after)) return;
+    // Single writer: plain load and store, no read-modify-write needed
+    Totals& totals = totals_[requestType];
+    totals.calls.store(totals.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    for (size_t e = 0; e < kPerfEvents; ++e) {
+        uint64_t delta = after[e] >= before[e] ? after[e] - before[e] : 0;
+        totals.counts[e].store(totals.counts[e].load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+}
+
+std::array<PerfTotals, kRequestTypes> PerfCounters::totals() const {
+    std::array<PerfTotals, kRequestTypes> out;
+    for (size_t t = 0; t < kRequestTypes; ++t) {
+        out[t].calls = totals_[t].calls.load(std::memory_order_relaxed);
+        for (size_t e = 0; e < kPerfEvents; ++e) out[t].counts[e] = totals_[t].counts[e].load(std::memory_order_relaxed);
+    }
+    return out;
+}
@@ -0,0 +1,533 @@
+#include "replication.h"
+#include "matching_engine.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    std::system_error socketError(const char* what) {
+        return std::system_error(errno, std::generic_category(), what);
+    }
+
+    sockaddr_un addressFor(const std::string& path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            throw std::system_error(ENAMETOOLONG, std::generic_category(), "replication socket path");
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return addr;
+    }
+}
+
+UnixSocketTransport::~UnixSocketTransport() {
+    ::close(fd_);
+}
+
+std::unique_ptr<UnixSocketTransport> UnixSocketTransport::listen(const std::string& path) {
+    sockaddr_un addr = addressFor(path);
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) throw socketError("replication socket");
+    ::unlink(path.c_str());
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listenFd, 1) < 0) {
+        auto error = socketError("replication bind");
+        ::close(listenFd);
+        throw error;
+    }
+    int fd;
+    while ((fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC)) < 0 && errno == EINTR) {}
+    auto error = socketError("replication accept");
+    ::close(listenFd);
+    ::unlink(path.c_str());
+    if (fd < 0) throw error;
+    return std::make_unique<UnixSocketTransport>(fd);
+}
+
+std::unique_ptr<UnixSocketTransport> UnixSocketTransport::connect(const std::string& path) {
+    sockaddr_un addr = addressFor(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw socketError("replication socket");
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        auto error = socketError("replication connect");
+        ::close(fd);
+        throw error;
+    }
+    return std::make_unique<UnixSocketTransport>(fd);
+}
+
+std::pair<std::unique_ptr<UnixSocketTransport>, std::unique_ptr<UnixSocketTransport>> UnixSocketTransport::pair() {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) throw socketError("replication socketpair");
+    return {std::make_unique<UnixSocketTransport>(fds[0]), std::make_unique<UnixSocketTransport>(fds[1])};
+}
+
+bool UnixSocketTransport::send(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::send(fd_, data, length, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+size_t UnixSocketTransport::receive(char* data, size_t capacity) {
+    while (true) {
+        ssize_t n = ::recv(fd_, data, capacity, 0);
+        if (n >= 0) return static_cast<size_t>(n);
+        if (errno != EINTR) return 0;
+    }
+}
+
+void UnixSocketTransport::close() {
+    ::shutdown(fd_, SHUT_RDWR);
+}
+
+namespace replication {
+
+namespace {
+    enum RiskByte : uint8_t { kNoCheck = 0, kAccepted = 1, kRejected = 2 };
+
+    // NewOrderParams optionals
+    constexpr uint8_t kHasPrice = 1 << 0;
+    constexpr uint8_t kHasStopPrice = 1 << 1;
+    constexpr uint8_t kHasDisplayQty = 1 << 2;
+    constexpr uint8_t kHasExpiry = 1 << 3;
+    // MassCancelRequest optionals
+    constexpr uint8_t kHasClient = 1 << 0;
+    constexpr uint8_t kHasSide = 1 << 1;
+
+    template<class T>
+    void put(std::vector<char>& out, const T& value) {
+        size_t at = out.size();
+        out.resize(at + sizeof(T));
+        std::memcpy(out.data() + at, &value, sizeof(T));
+    }
+
+    void putString(std::vector<char>& out, std::string_view s) {
+        put(out, static_cast<uint16_t>(s.size()));
+        out.insert(out.end(), s.begin(), s.begin() + static_cast<uint16_t>(s.size()));
+    }
+
+    // Bounds-checked cursor over a body; any short read marks it bad
+    struct Reader {
+        const char* at;
+        const char* end;
+        bool ok{true};
+
+        template<class T>
+        T get() {
+            T value{};
+            if (static_cast<size_t>(end - at) < sizeof(T)) {
+                ok = false;
+                return value;
+            }
+            std::memcpy(&value, at, sizeof(T));
+            at += sizeof(T);
+            return value;
+        }
+
+        std::string getString() {
+            auto size = get<uint16_t>();
+            if (!ok || static_cast<size_t>(end - at) < size) {
+                ok = false;
+                return {};
+            }
+            std::string s(at, size);
+            at += size;
+            return s;
+        }
+    };
+
+    void putAllocation(std::vector<char>& out, const AllocationRules& rules) {
+        put(out, static_cast<uint8_t>(rules.policy));
+        put(out, static_cast<uint8_t>(rules.top_order_priority));
+        put(out, rules.top_order_cap);
+        put(out, rules.min_allocation);
+        put(out, rules.fifo_share);
+    }
+
+    AllocationRules getAllocation(Reader& in) {
+        AllocationRules rules;
+        rules.policy = static_cast<MatchingPolicy>(in.get<uint8_t>());
+        rules.top_order_priority = in.get<uint8_t>() != 0;
+        rules.top_order_cap = in.get<Qty>();
+        rules.min_allocation = in.get<Qty>();
+        rules.fifo_share = in.get<double>();
+        return rules;
+    }
+
+    void putOwner(std::vector<char>& out, const std::optional<ClientId>& client) {
+        put(out, static_cast<uint8_t>(client ? kHasClient : 0));
+        putString(out, client.value_or(ClientId{}));
+    }
+
+    std::optional<ClientId> getOwner(Reader& in) {
+        auto flags = in.get<uint8_t>();
+        auto client = in.getString();
+        if (!(flags & kHasClient)) return std::nullopt;
+        return client;
+    }
+
+    std::optional<TradingRequest> getRequest(Reader& in) {
+        auto index = in.get<uint8_t>();
+        auto requestId = in.get<ReqId>();
+        std::optional<TradingRequest> request;
+        switch (index) {
+            case 0: {
+                auto kind = OrderKind{in.get<uint8_t>()};
+                NewOrderParams params;
+                params.id = in.get<OrdId>();
+                params.side = static_cast<Side>(in.get<uint8_t>());
+                params.tif = static_cast<TimeInForce>(in.get<uint8_t>());
+                auto flags = in.get<uint8_t>();
+                params.qty = in.get<Qty>();
+                auto price = in.get<Px>();
+                auto stopPrice = in.get<Px>();
+                auto displayQty = in.get<Qty>();
+                auto expireAt = in.get<uint64_t>();
+                params.client = in.getString();
+                if (flags & kHasPrice) params.price = price;
+                if (flags & kHasStopPrice) params.stop_price = stopPrice;
+                if (flags & kHasDisplayQty) params.display_qty = displayQty;
+                if (flags & kHasExpiry) params.expire_at = Timestamp{expireAt};
+                request.emplace(NewOrderRequest(Symb{}, kind, std::move(params)));
+                break;
+            }
+            case 1: {
+                auto orderId = in.get<OrdId>();
+                auto owner = getOwner(in);
+                request.emplace(CancelOrderRequest(Symb{}, orderId, std::move(owner)));
+                break;
+            }
+            case 2: {
+                auto orderId = in.get<OrdId>();
+                auto price = in.get<Px>();
+                auto qty = in.get<Qty>();
+                auto owner = getOwner(in);
+                request.emplace(ModifyOrderRequest(Symb{}, orderId, price, qty, std::move(owner)));
+                break;
+            }
+            case 3: {
+                auto flags = in.get<uint8_t>();
+                auto side = static_cast<Side>(in.get<uint8_t>());
+                auto client = in.getString();
+                std::optional<ClientId> owner;
+                if (flags & kHasClient) owner = std::move(client);
+                request.emplace(MassCancelRequest(Symb{}, std::move(owner),
+                                                  flags & kHasSide ? std::optional<Side>(side) : std::nullopt));
+                break;
+            }
+            case 4: {
+                auto phase = static_cast<TradingPhase>(in.get<uint8_t>());
+                request.emplace(TradingPhaseRequest(Symb{}, phase));
+                break;
+            }
+            default:
+                return std::nullopt;
+        }
+        if (!in.ok) return std::nullopt;
+        std::visit([requestId](auto& r) { r.request_id = requestId; }, *request);
+        return request;
+    }
+}
+
+void encode_request(std::vector<char>& body, const TradingRequest& request) {
+    put(body, static_cast<uint8_t>(request.index()));
+    std::visit([&body](const auto& r) { put(body, r.request_id); }, request);
+    std::visit(Overloaded{
+        [&body](const NewOrderRequest& r) {
+            const NewOrderParams& p = r.params;
+            uint8_t flags = (p.price ? kHasPrice : 0) | (p.stop_price ? kHasStopPrice : 0) |
+                            (p.display_qty ? kHasDisplayQty : 0) | (p.expire_at ? kHasExpiry : 0);
+            put(body, static_cast<uint8_t>(r.order_type));
+            put(body, p.id);
+            put(body, static_cast<uint8_t>(p.side));
+            put(body, static_cast<uint8_t>(p.tif));
+            put(body, flags);
+            put(body, p.qty);
+            put(body, p.price.value_or(0.0));
+            put(body, p.stop_price.value_or(0.0));
+            put(body, p.display_qty.value_or(0));
+            put(body, p.expire_at.value_or(Timestamp{}).ticks);
+            putString(body, p.client);
+        },
+        [&body](const CancelOrderRequest& r) {
+            put(body, r.order_id);
+            putOwner(body, r.client_id);
+        },
+        [&body](const ModifyOrderRequest& r) {
+            put(body, r.order_id);
+            put(body, r.new_price);
+            put(body, r.new_quantity);
+            putOwner(body, r.client_id);
+        },
+        [&body](const MassCancelRequest& r) {
+            put(body, static_cast<uint8_t>((r.client_id ? kHasClient : 0) | (r.side ? kHasSide : 0)));
+            put(body, static_cast<uint8_t>(r.side.value_or(Side::BUY)));
+            putString(body, r.client_id.value_or(ClientId{}));
+        },
+        [&body](const TradingPhaseRequest& r) {
+            put(body, static_cast<uint8_t>(r.phase));
+        }
+    }, request);
+}
+
+void encode_expired(std::vector<char>& body, const std::vector<OrdId>& expired) {
+    put(body, static_cast<uint32_t>(expired.size()));
+    for (OrdId id : expired) put(body, id);
+}
+
+void encode_listing(std::vector<char>& body, const Symb& symbol, const AllocationRules& allocation, Timestamp sessionClose) {
+    putString(body, symbol);
+    putAllocation(body, allocation);
+    put(body, sessionClose.ticks);
+}
+
+void encode_allocation(std::vector<char>& body, const AllocationRules& allocation) {
+    putAllocation(body, allocation);
+}
+
+void encode_session_close(std::vector<char>& body, Timestamp close) {
+    put(body, close.ticks);
+}
+
+size_t frame_length(const char* data, size_t available) {
+    if (available < sizeof(uint32_t)) return 0;
+    uint32_t length;
+    std::memcpy(&length, data, sizeof(length));
+    return length;
+}
+
+std::optional<Frame> decode(const char* data, size_t length) {
+    if (length < sizeof(FrameHeader)) return std::nullopt;
+    FrameHeader hdr;
+    std::memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.length != length) return std::nullopt;
+
+    Frame frame;
+    frame.type = hdr.type;
+    frame.symbol_id = hdr.symbol_id;
+    frame.seq = hdr.seq;
+    frame.ingress = Timestamp{hdr.ingress};
+    frame.checksum = hdr.checksum;
+    Reader in{data + sizeof(hdr), data + length};
+    switch (hdr.type) {
+        case FrameType::REQUEST:
+            frame.request = getRequest(in);
+            if (!frame.request) return std::nullopt;
+            for (auto count = in.get<uint32_t>(); in.ok && count > 0; --count) {
+                frame.expired.push_back(in.get<OrdId>());
+            }
+            if (hdr.risk == kAccepted) frame.risk = RiskDecision{};
+            if (hdr.risk == kRejected) {
+                frame.risk = RiskDecision{false, {}};
+                frame.breach = in.getString();
+            }
+            break;
+        case FrameType::LIST:
+            frame.symbol = in.getString();
+            frame.allocation = getAllocation(in);
+            frame.session_close = Timestamp{in.get<uint64_t>()};
+            break;
+        case FrameType::DELIST:
+            break;
+        case FrameType::SESSION_CLOSE:
+            frame.session_close = Timestamp{in.get<uint64_t>()};
+            break;
+        case FrameType::ALLOCATION:
+            frame.allocation = getAllocation(in);
+            break;
+        default:
+            return std::nullopt;
+    }
+    if (!in.ok) return std::nullopt;
+    return frame;
+}
+
+} // namespace replication
+
+Replicator::Replicator(std::unique_ptr<ReplicationTransport> transport, ReplicationConfig config)
+    : transport_(std::move(transport)), config_(config) {
+    sendThread_ = std::thread(&Replicator::sendLoop, this);
+    ackThread_ = std::thread(&Replicator::ackLoop, this);
+}
+
+Replicator::~Replicator() {
+    shutdown();
+}
+
+uint64_t Replicator::append(const replication::FrameMeta& meta, const std::vector<char>& body) {
+    using namespace replication;
+    if (lost_.load(std::memory_order_acquire)) return 0;
+
+    std::string_view breach = meta.risk && !meta.risk->accepted ? meta.risk->breach : std::string_view{};
+    FrameHeader hdr{
+        .length = 0,
+        .type = meta.type,
+        .risk = static_cast<uint8_t>(!meta.risk ? kNoCheck : meta.risk->accepted ? kAccepted : kRejected),
+        .reserved = 0,
+        .symbol_id = meta.symbol_id,
+        .seq = 0,
+        .ingress = meta.ingress.ticks,
+        .checksum = meta.checksum
+    };
+    size_t length = sizeof(hdr) + body.size() + (hdr.risk == kRejected ? sizeof(uint16_t) + breach.size() : 0);
+    hdr.length = static_cast<uint32_t>(length);
+
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    spaceCondition_.wait(lock, [this] {
+        return queue_.size() < config_.max_queued_bytes || stopping_ || lost_.load(std::memory_order_relaxed);
+    });
+    if (lost_.load(std::memory_order_relaxed)) return 0;
+    hdr.seq = nextSeq_++;
+    bool wake = queue_.empty();
+    put(queue_, hdr);
+    queue_.insert(queue_.end(), body.begin(), body.end());
+    if (hdr.risk == kRejected) putString(queue_, breach);
+    lock.unlock();
+    if (wake) queueCondition_.notify_one();
+    return hdr.seq;
+}
+
+void Replicator::whenAcked(uint64_t seq, AckCallback callback) {
+    {
+        std::lock_guard<std::mutex> lock(ackMutex_);
+        // Checked under the lock so release() can't run in between
+        if (acked_.load(std::memory_order_acquire) < seq && !lost_.load(std::memory_order_acquire)) {
+            pendingAcks_.emplace(seq, std::move(callback));
+            return;
+        }
+    }
+    callback();
+}
+
+void Replicator::sendLoop() {
+    std::vector<char> sending;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueCondition_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+            if (queue_.empty()) return;
+            sending.swap(queue_);
+        }
+        spaceCondition_.notify_all();
+        if (!lost_.load(std::memory_order_acquire) && !transport_->send(sending.data(), sending.size())) {
+            lose("send failed");
+        }
+        sending.clear();
+    }
+}
+
+void Replicator::ackLoop() {
+    // Acks are cumulative stream sequences, 8 bytes each
+    char buffer[4096];
+    size_t have = 0;
+    while (size_t n = transport_->receive(buffer + have, sizeof(buffer) - have)) {
+        have += n;
+        size_t whole = have - have % sizeof(uint64_t);
+        if (whole == 0) continue;
+        uint64_t seq;
+        std::memcpy(&seq, buffer + whole - sizeof(seq), sizeof(seq));
+        std::memmove(buffer, buffer + whole, have - whole);
+        have -= whole;
+        release(seq);
+    }
+    bool stopping;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping = stopping_;
+    }
+    if (!stopping) lose("backup disconnected");
+}
+
+void Replicator::release(uint64_t upto) {
+    std::vector<AckCallback> ready;
+    {
+        std::lock_guard<std::mutex> lock(ackMutex_);
+        if (upto > acked_.load(std::memory_order_relaxed)) acked_.store(upto, std::memory_order_release);
+        auto end = pendingAcks_.upper_bound(upto);
+        for (auto it = pendingAcks_.begin(); it != end; ++it) ready.push_back(std::move(it->second));
+        pendingAcks_.erase(pendingAcks_.begin(), end);
+    }
+    for (auto& callback : ready) callback();
+}
+
+void Replicator::lose(const char* why) {
+    if (lost_.exchange(true, std::memory_order_acq_rel)) return;
+    std::cerr << "Error: replication stopped, " << why << "; continuing without a backup" << std::endl;
+    spaceCondition_.notify_all();
+    release(std::numeric_limits<uint64_t>::max());
+}
+
+void Replicator::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (stopping_) return;
+        stopping_ = true;
+    }
+    queueCondition_.notify_all();
+    spaceCondition_.notify_all();
+    if (sendThread_.joinable()) sendThread_.join();
+    transport_->close();
+    if (ackThread_.joinable()) ackThread_.join();
+    // Nothing more will be acknowledged
+    lost_.store(true, std::memory_order_release);
+    release(std::numeric_limits<uint64_t>::max());
+}
+
+ReplicaReceiver::ReplicaReceiver(std::unique_ptr<ReplicationTransport> transport, Apply apply)
+    : transport_(std::move(transport)), apply_(std::move(apply)) {
+    thread_ = std::thread(&ReplicaReceiver::receiveLoop, this);
+}
+
+ReplicaReceiver::~ReplicaReceiver() {
+    stop();
+}
+
+void ReplicaReceiver::stop() {
+    stopping_.store(true, std::memory_order_release);
+    transport_->close();
+    if (thread_.joinable()) thread_.join();
+}
+
+void ReplicaReceiver::receiveLoop() {
+    std::vector<char> buffer(64 * 1024);
+    size_t have = 0;
+    uint64_t last = 0;
+    while (size_t n = transport_->receive(buffer.data() + have, buffer.size() - have)) {
+        have += n;
+        size_t at = 0;
+        uint64_t batchEnd = 0;
+        while (size_t length = replication::frame_length(buffer.data() + at, have - at)) {
+            if (length >= sizeof(replication::FrameHeader) && length > have - at) {
+                if (length > buffer.size()) buffer.resize(length);
+                break;
+            }
+            auto frame = length < sizeof(replication::FrameHeader) || length > have - at
+                ? std::nullopt : replication::decode(buffer.data() + at, length);
+            if (!frame || frame->seq != last + 1) {
+                std::cerr << "Error: replication stream broken after sequence " << last << std::endl;
+                broken_.store(true, std::memory_order_release);
+                return;
+            }
+            last = frame->seq;
+            at += length;
+            if (stopping_.load(std::memory_order_acquire)) return;
+            apply_(std::move(*frame));
+            received_.store(last, std::memory_order_release);
+            batchEnd = last;
+        }
+        std::memmove(buffer.data(), buffer.data() + at, have - at);
+        have -= at;
+        if (batchEnd && !transport_->send(reinterpret_cast<const char*>(&batchEnd), sizeof(batchEnd))) break;
+    }
+}
@@ -0,0 +1,92 @@
+#include "risk_manager.h"
+#include <cstdlib>
+
+namespace {
+    int64_t signedQty(Side side, Qty qty) {
+        return side == Side::BUY ? static_cast<int64_t>(qty) : -static_cast<int64_t>(qty);
+    }
+
+    RiskDecision checkLimits(const RiskLimits& limits, int64_t open_orders, int64_t net_position,
+                             Side side, Px ref_price, Qty qty, bool replacing) {
+        if (qty > limits.max_order_qty) {
+            return {false, "max order quantity"};
+        }
+        if (ref_price * qty > limits.max_notional) {
+            return {false, "max notional"};
+        }
+        if (!replacing && open_orders >= limits.max_open_orders) {
+            return {false, "max open orders"};
+        }
+        // Worst case: the whole order fills
+        int64_t projected = net_position + signedQty(side, qty);
+        if (std::llabs(projected) > limits.max_net_position) {
+            return {false, "max net position"};
+        }
+        return {};
+    }
+}
+
+RiskManager::RiskManager(size_t capacity, RiskLimits defaults)
+    : defaults_(defaults),
+      table_(capacity,
+             [this](Slot& slot) {
+                 storeLimits(slot, defaults_);
+                 slot.explicit_limits.store(false, std::memory_order_relaxed);
+                 slot.net_position.store(0, std::memory_order_relaxed);
+                 slot.open_orders.store(0, std::memory_order_relaxed);
+             },
+             [](const Slot& slot) {
+                 return !slot.explicit_limits.load(std::memory_order_relaxed) &&
+                        slot.open_orders.load(std::memory_order_relaxed) == 0 &&
+                        slot.net_position.load(std::memory_order_relaxed) == 0;
+             }) {}
+
+bool RiskManager::setLimits(const ClientId& client, const RiskLimits& limits) {
+    auto slot = table_.acquire(client);
+    if (!slot) return false;
+    storeLimits(*slot, limits);
+    slot->explicit_limits.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+RiskDecision RiskManager::check(const ClientId& client, Side side, Px ref_price, Qty qty, bool replacing) {
+    auto slot = table_.acquire(client);
+    if (!slot) return checkLimits(defaults_, 0, 0, side, ref_price, qty, replacing);
+    RiskLimits limits{
+        .max_order_qty = slot->max_order_qty.load(std::memory_order_relaxed),
+        .max_notional = slot->max_notional.load(std::memory_order_relaxed),
+        .max_open_orders = slot->max_open_orders.load(std::memory_order_relaxed),
+        .max_net_position = slot->max_net_position.load(std::memory_order_relaxed)
+    };
+    return checkLimits(limits, slot->open_orders.load(std::memory_order_relaxed),
+                       slot->net_position.load(std::memory_order_relaxed), side, ref_price, qty, replacing);
+}
+
+void RiskManager::onOrderOpened(const ClientId& client) {
+    if (auto slot = table_.acquire(client)) slot->open_orders.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RiskManager::onOrderClosed(const ClientId& client) {
+    if (auto slot = table_.find(client)) slot->open_orders.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void RiskManager::onFill(const ClientId& client, Side side, Qty qty) {
+    if (auto slot = table_.acquire(client)) slot->net_position.fetch_add(signedQty(side, qty), std::memory_order_relaxed);
+}
+
+int64_t RiskManager::netPosition(const ClientId& client) {
+    auto slot = table_.find(client);
+    return slot ? slot->net_position.load(std::memory_order_relaxed) : 0;
+}
+
+int64_t RiskManager::openOrders(const ClientId& client) {
+    auto slot = table_.find(client);
+    return slot ? slot->open_orders.load(std::memory_order_relaxed) : 0;
+}
+
+void RiskManager::storeLimits(Slot& slot, const RiskLimits& limits) {
+    slot.max_order_qty.store(limits.max_order_qty, std::memory_order_relaxed);
+    slot.max_notional.store(limits.max_notional, std::memory_order_relaxed);
+    slot.max_open_orders.store(limits.max_open_orders, std::memory_order_relaxed);
+    slot.max_net_position.store(limits.max_net_position, std::memory_order_relaxed);
+}
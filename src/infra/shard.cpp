@@ -0,0 +1,152 @@
+#include "shard.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t kHugePage = size_t{2} << 20;
+    constexpr size_t kPage = 4096;
+    constexpr int kMpolPreferred = 1;  // <numaif.h>, without linking libnuma
+
+    size_t roundUp(size_t value, size_t to) { return (value + to - 1) / to * to; }
+
+    // CPUs this process may run on, in order
+    std::vector<int> allowedCpus() {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    bool pinTo(int cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    int currentNode() {
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return -1;
+        return static_cast<int>(node);
+    }
+}
+
+ShardArena::ShardArena(size_t bytes, bool huge_pages, int node) {
+    if (bytes == 0) return;
+    size_ = roundUp(bytes, huge_pages ? kHugePage : kPage);
+
+    // Reserved huge pages first; they may well not be configured
+    void* mapped = MAP_FAILED;
+    if (huge_pages) {
+        mapped = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        hugePages_ = mapped != MAP_FAILED;
+    }
+    if (mapped == MAP_FAILED && huge_pages) {
+        // Transparent huge pages need 2MB alignment: over-map and trim
+        void* raw = mmap(nullptr, size_ + kHugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED) {
+            auto start = reinterpret_cast<uintptr_t>(raw);
+            auto aligned = roundUp(start, kHugePage);
+            if (aligned > start) munmap(raw, aligned - start);
+            munmap(reinterpret_cast<void*>(aligned + size_), start + kHugePage - aligned);
+            mapped = reinterpret_cast<void*>(aligned);
+            hugePages_ = madvise(mapped, size_, MADV_HUGEPAGE) == 0;
+        }
+    }
+    if (mapped == MAP_FAILED) {
+        mapped = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: shard arena of " << size_ << " bytes: " << std::strerror(errno) << std::endl;
+        size_ = 0;
+        return;
+    }
+    base_ = static_cast<char*>(mapped);
+
+    // Best effort; without it first touch below still places the pages on
+    // the calling thread's node
+    if (node >= 0 && node < 64) {
+        unsigned long mask = 1UL << node;
+        syscall(SYS_mbind, base_, size_, kMpolPreferred, &mask, sizeof(mask) * 8, 0);
+    }
+
+    // Pre-fault every page now rather than on the matching path
+    for (size_t offset = 0; offset < size_; offset += kPage) {
+        static_cast<volatile char*>(base_)[offset] = 0;
+    }
+}
+
+ShardArena::~ShardArena() {
+    if (base_) munmap(base_, size_);
+}
+
+void* ShardArena::do_allocate(size_t bytes, size_t alignment) {
+    size_t offset = roundUp(used(), alignment);
+    if (base_ && offset + bytes <= size_) {
+        used_.store(offset + bytes, std::memory_order_relaxed);
+        return base_ + offset;
+    }
+    spilled_.store(spilled() + bytes, std::memory_order_relaxed);
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void ShardArena::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    auto* at = static_cast<char*>(p);
+    if (base_ && at >= base_ && at < base_ + size_) return;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+Shard::Shard(size_t index, const ShardConfig& config) : index_(index) {
+    run([this, index, &config] {
+        if (config.pin_threads) {
+            auto cpus = allowedCpus();
+            if (!cpus.empty() && pinTo(cpus[index % cpus.size()])) {
+                cpu_ = cpus[index % cpus.size()];
+                node_ = currentNode();
+            }
+        }
+        arena_ = std::make_unique<ShardArena>(config.arena_bytes, config.huge_pages, node_);
+        pool_resource_ = std::make_unique<std::pmr::unsynchronized_pool_resource>(arena_.get());
+        if (config.perf_counters) {
+            // Opened here: the counters follow the thread that opens them
+            auto counters = std::make_unique<PerfCounters>();
+            if (counters->available()) {
+                perf_ = std::move(counters);
+            } else {
+                std::cerr << "Error: perf counters unavailable on shard " << index << std::endl;
+            }
+        }
+    });
+}
+
+Shard::~Shard() {
+    shutdown();
+}
+
+void Shard::run(const std::function<void()>& f) {
+    std::promise<void> done;
+    auto result = done.get_future();
+    pool_.submit([&f, &done] {
+        try {
+            f();
+            done.set_value();
+        } catch (...) {
+            done.set_exception(std::current_exception());
+        }
+    });
+    result.get();
+}
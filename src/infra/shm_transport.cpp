@@ -0,0 +1,342 @@
+#include "shm_transport.h"
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t kPollBatch = 64;
+    constexpr size_t kIdleSpins = 1000;
+    constexpr auto kHousekeepingPeriod = std::chrono::milliseconds(10);
+    constexpr int64_t kServerStaleNs = 1000000000;
+
+    // Largest report that still fits one ring slot
+    constexpr size_t kFillsPerSlot =
+        (shm::MessageRing<shm::kReportSlots>::kPayload - sizeof(wire::ExecReport)) / sizeof(wire::ExecFill);
+
+    bool processGone(int32_t pid) {
+        return pid > 0 && ::kill(pid, 0) != 0 && errno == ESRCH;
+    }
+
+    std::system_error shmError(const char* what) {
+        return std::system_error(errno, std::generic_category(), what);
+    }
+}
+
+ShmServer::ShmServer(Exchange& exchange, std::string name, Config config)
+    : exchange_(exchange), name_(std::move(name)), config_(config), channels_(shm::kMaxClients) {
+    // A segment left behind by a crashed server is replaced, not reused
+    ::shm_unlink(name_.c_str());
+    int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) throw shmError("shm_open");
+    if (::ftruncate(fd, sizeof(shm::Segment)) != 0) {
+        auto error = shmError("ftruncate");
+        ::close(fd);
+        ::shm_unlink(name_.c_str());
+        throw error;
+    }
+    // Pre-fault the whole segment so first touches don't land on the fast path
+    void* mapped = ::mmap(nullptr, sizeof(shm::Segment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        auto error = shmError("mmap");
+        ::shm_unlink(name_.c_str());
+        throw error;
+    }
+
+    auto* segment = new (mapped) shm::Segment;
+    segment_ = std::shared_ptr<shm::Segment>(segment, [](shm::Segment* s) {
+        ::munmap(s, sizeof(shm::Segment));
+    });
+    segment->market_data.reset();
+    for (auto& channel : segment->clients) {
+        channel.state.store(shm::FREE, std::memory_order_relaxed);
+        channel.generation.store(0, std::memory_order_relaxed);
+        channel.pid.store(0, std::memory_order_relaxed);
+        channel.requests.reset();
+        channel.reports.reset();
+    }
+    segment->max_clients = shm::kMaxClients;
+    segment->server_pid.store(::getpid(), std::memory_order_relaxed);
+    segment->server_heartbeat_ns.store(shm::monotonic_ns(), std::memory_order_relaxed);
+    segment->magic = shm::kMagic;
+    segment->server_up.store(1, std::memory_order_release);
+
+    exchange_.setMarketDataSink(Exchange::MarketDataSink{
+        .onTrade = [segment = segment_](SymbolId symbol, const Fill& fill) {
+            shm::MarketDataEvent event{};
+            event.type = shm::MarketDataEvent::TRADE;
+            event.taker_is_buy = fill.taker_is_buy;
+            event.symbol_id = symbol;
+            // Raw ticks; readers convert them, never the matching strand
+            event.ts_ns = static_cast<int64_t>(fill.ts.ticks);
+            event.match_seq = fill.match_seq;
+            event.price = fill.price;
+            event.qty = fill.qty;
+            segment->market_data.publish(event);
+        },
+        .onBook = [segment = segment_](SymbolId symbol, const L2Snapshot& top) {
+            shm::MarketDataEvent event{};
+            event.type = shm::MarketDataEvent::TOP_OF_BOOK;
+            event.symbol_id = symbol;
+            if (!top.bids.empty()) {
+                event.bid_price = top.bids.front().price;
+                event.bid_qty = top.bids.front().quantity;
+            }
+            if (!top.asks.empty()) {
+                event.ask_price = top.asks.front().price;
+                event.ask_qty = top.asks.front().quantity;
+            }
+            segment->market_data.publish(event);
+        },
+        .depth = 1
+    });
+
+    pollThread_ = std::thread(&ShmServer::pollLoop, this);
+    housekeepingThread_ = std::thread(&ShmServer::housekeepingLoop, this);
+}
+
+ShmServer::~ShmServer() {
+    shutdown();
+}
+
+void ShmServer::shutdown() {
+    if (stop_.exchange(true)) return;
+    segment_->server_up.store(0, std::memory_order_release);
+    if (pollThread_.joinable()) pollThread_.join();
+    if (housekeepingThread_.joinable()) housekeepingThread_.join();
+    for (auto& cached : channels_) {
+        if (cached.attached.exchange(false, std::memory_order_acq_rel)) exchange_.detachClient(cached.client);
+    }
+    ::shm_unlink(name_.c_str());
+    // The sink and any in-flight completions keep the mapping alive
+    segment_.reset();
+}
+
+size_t ShmServer::activeClients() const {
+    size_t active = 0;
+    if (!segment_) return active;
+    for (const auto& channel : segment_->clients) {
+        active += channel.state.load(std::memory_order_relaxed) == shm::ACTIVE;
+    }
+    return active;
+}
+
+void ShmServer::pollLoop() {
+    shm::Segment& segment = *segment_;
+    size_t idle = 0;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        bool busy = false;
+        for (size_t i = 0; i < shm::kMaxClients; ++i) {
+            shm::ClientChannel& channel = segment.clients[i];
+            if (channel.state.load(std::memory_order_acquire) != shm::ACTIVE) continue;
+
+            uint32_t generation = channel.generation.load(std::memory_order_acquire);
+            Channel& cached = channels_[i];
+            if (cached.generation != generation) {
+                cached.client.assign(channel.client_id, strnlen(channel.client_id, wire::kClientIdLength));
+                cached.generation = generation;
+                if (!exchange_.attachClient(cached.client)) {
+                    // The exchange can't track another client: refuse the logon
+                    uint32_t expected = shm::ACTIVE;
+                    channel.state.compare_exchange_strong(expected, shm::CLOSING);
+                    continue;
+                }
+                cached.attached.store(true, std::memory_order_release);
+            }
+
+            for (size_t n = 0; n < kPollBatch; ++n) {
+                bool popped = channel.requests.pop([&](const char* data, size_t length) {
+                    auto decoded = wire::decode_request(data, length, cached.client);
+                    if (!decoded) {
+                        // Protocol violation: hand the channel to the reaper
+                        uint32_t expected = shm::ACTIVE;
+                        channel.state.compare_exchange_strong(expected, shm::CLOSING);
+                        return;
+                    }
+                    exchange_.submitRequest(decoded->symbol, std::move(decoded->request), reportTo(i, generation));
+                });
+                if (!popped) break;
+                busy = true;
+            }
+        }
+        pollPasses_.fetch_add(1, std::memory_order_release);
+
+        if (busy) {
+            idle = 0;
+        } else if (++idle > kIdleSpins) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ShmServer::housekeepingLoop() {
+    shm::Segment& segment = *segment_;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        int64_t now = shm::monotonic_ns();
+        segment.server_heartbeat_ns.store(now, std::memory_order_release);
+
+        for (auto& channel : segment.clients) {
+            uint32_t state = channel.state.load(std::memory_order_acquire);
+            if (state == shm::ACTIVE && peerDead(channel, now)) {
+                channel.state.compare_exchange_strong(state, shm::CLOSING);
+                state = channel.state.load(std::memory_order_acquire);
+            }
+            if (state == shm::CLOSING) {
+                reap(channel);
+                state = shm::REAPED;
+            }
+            int32_t pid = channel.pid.load(std::memory_order_acquire);
+            if (state == shm::REAPED && (pid == 0 || processGone(pid))) {
+                // The client has let go or died: nothing can touch the rings now
+                channel.requests.reset();
+                channel.reports.reset();
+                channel.pid.store(0, std::memory_order_relaxed);
+                channel.state.store(shm::FREE, std::memory_order_release);
+            } else if (state == shm::CLAIMED && processGone(pid)) {
+                // Died half way through registering
+                channel.state.store(shm::FREE, std::memory_order_release);
+            }
+        }
+        std::this_thread::sleep_for(kHousekeepingPeriod);
+    }
+}
+
+bool ShmServer::peerDead(const shm::ClientChannel& channel, int64_t now) const {
+    if (processGone(channel.pid.load(std::memory_order_relaxed))) return true;
+    if (config_.heartbeat_timeout.count() <= 0) return false;
+    int64_t timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(config_.heartbeat_timeout).count();
+    return now - channel.heartbeat_ns.load(std::memory_order_relaxed) > timeout;
+}
+
+void ShmServer::reap(shm::ClientChannel& channel) {
+    // Let the poll thread finish any pass that still saw the channel active
+    uint64_t passes = pollPasses_.load(std::memory_order_acquire);
+    while (pollPasses_.load(std::memory_order_acquire) < passes + 2 && !stop_.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+    }
+
+    ClientId client(channel.client_id, strnlen(channel.client_id, wire::kClientIdLength));
+    if (config_.cancel_on_disconnect) {
+        // Also a barrier: every strand has run this client's earlier requests
+        exchange_.cancelAllForClient(client);
+    }
+    if (channels_[&channel - segment_->clients].attached.exchange(false, std::memory_order_acq_rel)) {
+        exchange_.detachClient(client);
+    }
+
+    // Reports still in flight see the new generation and are dropped. The
+    // client may still be running, so its rings are left alone until the
+    // channel is freed
+    channel.generation.fetch_add(1, std::memory_order_acq_rel);
+    channel.state.store(shm::REAPED, std::memory_order_release);
+}
+
+Exchange::Completion ShmServer::reportTo(size_t index, uint32_t generation) {
+    return [segment = segment_, index, generation](RequestOutcome&& outcome) {
+        shm::ClientChannel& channel = segment->clients[index];
+        thread_local std::vector<char> scratch;
+        scratch.clear();
+        wire::encode_report(scratch, outcome, kFillsPerSlot);
+
+        size_t offset = 0;
+        while (offset < scratch.size()) {
+            uint32_t length = wire::view<wire::Header>(scratch.data() + offset, scratch.size() - offset)->length;
+            if (channel.generation.load(std::memory_order_acquire) != generation) return;
+            if (!channel.reports.push(scratch.data() + offset, length)) {
+                // A full ring means a slow reader. Never stall the matching
+                // strand for it: hand the channel to the reaper, which
+                // cancels its orders, and drop the rest
+                uint32_t expected = shm::ACTIVE;
+                channel.state.compare_exchange_strong(expected, shm::CLOSING);
+                return;
+            }
+            offset += length;
+        }
+    };
+}
+
+ShmClient::ShmClient(const std::string& name, const ClientId& client) {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) throw shmError("shm_open");
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shm::Segment)) {
+        ::close(fd);
+        throw std::runtime_error("shared memory segment " + name + " has the wrong size");
+    }
+    void* mapped = ::mmap(nullptr, sizeof(shm::Segment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) throw shmError("mmap");
+    segment_ = static_cast<shm::Segment*>(mapped);
+
+    if (segment_->magic != shm::kMagic || !segment_->server_up.load(std::memory_order_acquire)) {
+        ::munmap(segment_, sizeof(shm::Segment));
+        throw std::runtime_error("no exchange serving " + name);
+    }
+
+    for (auto& channel : segment_->clients) {
+        uint32_t expected = shm::FREE;
+        if (channel.state.compare_exchange_strong(expected, shm::CLAIMED, std::memory_order_acq_rel)) {
+            channel_ = &channel;
+            break;
+        }
+    }
+    if (!channel_) {
+        ::munmap(segment_, sizeof(shm::Segment));
+        throw std::runtime_error("no free client channel in " + name);
+    }
+
+    channel_->pid.store(::getpid(), std::memory_order_relaxed);
+    std::memset(channel_->client_id, 0, sizeof(channel_->client_id));
+    std::memcpy(channel_->client_id, client.data(), std::min(client.size(), sizeof(channel_->client_id)));
+    heartbeat();
+    generation_ = channel_->generation.load(std::memory_order_acquire);
+    marketDataPos_ = segment_->market_data.head.load(std::memory_order_acquire);
+    channel_->state.store(shm::ACTIVE, std::memory_order_release);
+}
+
+ShmClient::~ShmClient() {
+    // The channel stays ours until we let go of it here, so this never
+    // touches a session the server has handed to another client. An active
+    // session goes to the reaper; a reaped one is freed on its next pass.
+    channel_->pid.store(0, std::memory_order_release);
+    uint32_t expected = shm::ACTIVE;
+    if (channel_->generation.load(std::memory_order_acquire) == generation_) {
+        channel_->state.compare_exchange_strong(expected, shm::CLOSING, std::memory_order_acq_rel);
+    }
+    ::munmap(segment_, sizeof(shm::Segment));
+}
+
+bool ShmClient::sendRaw(const char* data, size_t length) {
+    if (!segment_->server_up.load(std::memory_order_acquire) || !connected()) return false;
+    heartbeat();
+    return channel_->requests.push(data, length);
+}
+
+bool ShmClient::pollMarketData(shm::MarketDataEvent& out) {
+    while (true) {
+        switch (segment_->market_data.read(marketDataPos_, out)) {
+            case shm::BroadcastRing<shm::kMarketDataSlots>::Read::OK:
+                if (out.type == shm::MarketDataEvent::TRADE) {
+                    out.ts_ns = Clock::toWallNanos(Timestamp{static_cast<uint64_t>(out.ts_ns)});
+                }
+                return true;
+            case shm::BroadcastRing<shm::kMarketDataSlots>::Read::EMPTY:
+                return false;
+            case shm::BroadcastRing<shm::kMarketDataSlots>::Read::LAPPED:
+                ++gaps_;
+                break;
+        }
+    }
+}
+
+bool ShmClient::serverAlive() const {
+    if (!segment_->server_up.load(std::memory_order_acquire)) return false;
+    if (processGone(segment_->server_pid.load(std::memory_order_relaxed))) return false;
+    return shm::monotonic_ns() - segment_->server_heartbeat_ns.load(std::memory_order_acquire) < kServerStaleNs;
+}
@@ -1,14 +1,16 @@
 #include "strand.h"
 
-Strand::Strand(ThreadPool& threadPool) : threadPool_(threadPool) {}
+Strand::Strand(ThreadPool& threadPool) : threadPool_(&threadPool) {}
 
 void Strand::post(std::function<void()> task) {
     std::lock_guard<std::mutex> lock(mutex_);
     taskQueue_.push(std::move(task));
+    pending_.fetch_add(1, std::memory_order_relaxed);
     
     // If not currently running, start execution
     if (!running_.exchange(true)) {
-        threadPool_.submit([this]() { executeNext(); });
+        scheduled_ = Clock::now();
+        threadPool_->submit([this]() { executeNext(); });
     }
 }
 
@@ -24,6 +26,7 @@ void Strand::executeNext() {
         }
         task = std::move(taskQueue_.front());
         taskQueue_.pop();
+        pending_.fetch_sub(1, std::memory_order_relaxed);
     }
     
     // Execute the task
@@ -38,9 +41,15 @@ void Strand::executeNext() {
         std::lock_guard<std::mutex> lock(mutex_);
         if (!taskQueue_.empty()) {
             // Submit next execution
-            threadPool_.submit([this]() { executeNext(); });
+            scheduled_ = Clock::now();
+            threadPool_->submit([this]() { executeNext(); });
         } else {
             running_ = false;
         }
     }
-}
\ No newline at end of file
+}
+
+void Strand::rebind(ThreadPool& threadPool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threadPool_ = &threadPool;
+}
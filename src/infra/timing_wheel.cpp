@@ -0,0 +1,77 @@
+#include "timing_wheel.h"
+
+void TimingWheel::schedule(OrdId id, Tick deadline) {
+    // The current tick's slot has already fired: a deadline already passed
+    // goes in the next one, still carrying the deadline it was given
+    place(Entry{id, deadline}, deadline > current_ ? deadline : current_ + 1);
+}
+
+void TimingWheel::place(const Entry& entry, Tick due) {
+    // Lowest level whose slot for due is still ahead of current_ in this
+    // rotation; the slot current_ sits in has already been cascaded
+    int level = 0;
+    while (level < kLevels && (due >> (kSlotBits * level)) - (current_ >> (kSlotBits * level)) >= kSlots) {
+        ++level;
+    }
+
+    Tick slot;
+    if (level == kLevels) {
+        // Beyond the horizon: the top-level slot turned last
+        level = kLevels - 1;
+        slot = ((current_ >> (kSlotBits * level)) - 1) & kSlotMask;
+    } else {
+        slot = (due >> (kSlotBits * level)) & kSlotMask;
+    }
+
+    levels_[level][slot].push_back(entry);
+    ++level_counts_[level];
+    ++count_;
+}
+
+void TimingWheel::cascade(int level) {
+    if (level >= kLevels) return;
+
+    Tick index = (current_ >> (kSlotBits * level)) & kSlotMask;
+    if (index == 0) cascade(level + 1);
+
+    Slot due;
+    due.swap(levels_[level][index]);
+    level_counts_[level] -= due.size();
+    count_ -= due.size();
+    for (const auto& entry : due) {
+        place(entry, entry.deadline > current_ ? entry.deadline : current_);
+    }
+}
+
+void TimingWheel::advance(Tick now, const ExpiryCallback& on_expire) {
+    while (current_ < now) {
+        if (count_ == 0) {
+            current_ = now;
+            return;
+        }
+        if (level_counts_[0] == 0) {
+            // Nothing at level 0: jump straight to the next wrap
+            Tick next_wrap = (current_ | kSlotMask) + 1;
+            if (next_wrap > now) {
+                current_ = now;
+                return;
+            }
+            current_ = next_wrap - 1;
+        }
+
+        ++current_;
+        if ((current_ & kSlotMask) == 0) cascade(1);
+
+        Slot due;
+        due.swap(levels_[0][current_ & kSlotMask]);
+        level_counts_[0] -= due.size();
+        count_ -= due.size();
+        for (const auto& entry : due) {
+            if (entry.deadline <= current_) {
+                on_expire(entry.id, entry.deadline);
+            } else {
+                place(entry, entry.deadline);  // parked beyond the horizon, not due yet
+            }
+        }
+    }
+}
@@ -0,0 +1,171 @@
+#include "tracing.h"
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace {
+    std::atomic<uint64_t> nextTracerId{1};
+
+    int64_t steadyNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void writeMicros(std::ostream& out, uint64_t ns) {
+        out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000;
+    }
+}
+
+struct Tracer::Ring {
+    struct Slot {
+        std::atomic<uint64_t> seq{0};  // odd while being written
+        TraceSpan span;
+    };
+
+    Ring(size_t capacity, pid_t tid)
+        : slots(std::make_unique<Slot[]>(capacity)), mask(capacity - 1), tid(tid) {
+        char buffer[32] = {};
+        if (pthread_getname_np(pthread_self(), buffer, sizeof(buffer)) == 0) name = buffer;
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    uint64_t head{0};  // owning thread only
+    pid_t tid;
+    std::string name;
+};
+
+Tracer::Tracer(TraceConfig config)
+    : config_(std::move(config)),
+      id_(nextTracerId.fetch_add(1, std::memory_order_relaxed)),
+      thresholdTicks_(Clock::ticksFor(config_.dump_threshold)) {
+    if (config_.enabled && config_.dump_threshold.count() > 0) {
+        dumpThread_ = std::thread(&Tracer::dumpLoop, this);
+    }
+}
+
+Tracer::~Tracer() {
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex_);
+        stop_ = true;
+    }
+    dumpWake_.notify_all();
+    if (dumpThread_.joinable()) dumpThread_.join();
+}
+
+bool Tracer::sample() {
+    thread_local uint32_t submitted = 0;
+    return config_.enabled && config_.sample_every && ++submitted % config_.sample_every == 0;
+}
+
+Tracer::Ring& Tracer::ring() {
+    struct Cached {
+        uint64_t tracer{0};
+        Ring* ring{nullptr};
+    };
+    thread_local Cached cached;
+    if (cached.tracer == id_) return *cached.ring;
+
+    // A thread that records for several tracers keeps one ring in each
+    pid_t tid = ::gettid();
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    Ring* found = nullptr;
+    for (auto& r : rings_) {
+        if (r->tid == tid) found = r.get();
+    }
+    if (!found) {
+        rings_.push_back(std::make_unique<Ring>(std::bit_ceil(std::max<size_t>(2, config_.ring_spans)), tid));
+        found = rings_.back().get();
+    }
+    cached = Cached{id_, found};
+    return *found;
+}
+
+void Tracer::record(const TraceSpan& span) {
+    Ring& r = ring();
+    Ring::Slot& slot = r.slots[r.head++ & r.mask];
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.span = span;
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+void Tracer::onLatency(Timestamp ingress, Timestamp done) {
+    if (thresholdTicks_ == 0 || done.ticks - ingress.ticks <= thresholdTicks_) return;
+    int64_t now = steadyNanos();
+    int64_t last = lastDumpNs_.load(std::memory_order_relaxed);
+    int64_t interval = std::chrono::duration_cast<std::chrono::nanoseconds>(config_.min_dump_interval).count();
+    if (last != 0 && now - last < interval) return;
+    if (!lastDumpNs_.compare_exchange_strong(last, now, std::memory_order_relaxed)) return;
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex_);
+        dumpWanted_ = true;
+    }
+    dumpWake_.notify_one();
+}
+
+void Tracer::write(std::ostream& out) const {
+    pid_t pid = ::getpid();
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto next = [&out, &first]() -> std::ostream& {
+        if (!first) out << ",\n";
+        first = false;
+        return out;
+    };
+
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    for (const auto& r : rings_) {
+        next() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << r->tid
+               << ",\"args\":{\"name\":\"" << (r->name.empty() ? "thread" : r->name) << "\"}}";
+        for (size_t i = 0; i <= r->mask; ++i) {
+            const Ring::Slot& slot = r->slots[i];
+            uint64_t before = slot.seq.load(std::memory_order_acquire);
+            if (before == 0 || (before & 1)) continue;
+            TraceSpan span = slot.span;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != before) continue;
+
+            uint64_t begin = Clock::toNanos(span.begin);
+            uint64_t end = std::max(begin, Clock::toNanos(span.end));
+            next() << "{\"name\":\"" << span.name << "\",\"cat\":\"request\",\"ph\":\"X\",\"pid\":" << pid
+                   << ",\"tid\":" << r->tid << ",\"ts\":";
+            writeMicros(out, begin);
+            out << ",\"dur\":";
+            writeMicros(out, end - begin);
+            out << ",\"args\":{\"request_id\":" << span.request_id << ",\"symbol_id\":" << span.symbol << "}}";
+        }
+    }
+    out << "]}\n";
+}
+
+std::string Tracer::dump() {
+    std::error_code error;
+    std::filesystem::create_directories(config_.dump_directory, error);
+    std::string path = config_.dump_directory + "trace-" + std::to_string(Clock::toWallNanos(Clock::now())) + ".json";
+    std::ofstream out(path);
+    if (out) write(out);
+    if (!out) {
+        std::cerr << "Error: could not write trace " << path << std::endl;
+        return {};
+    }
+    dumps_.fetch_add(1, std::memory_order_relaxed);
+    return path;
+}
+
+void Tracer::dumpLoop() {
+    std::unique_lock<std::mutex> lock(dumpMutex_);
+    while (true) {
+        dumpWake_.wait(lock, [this] { return dumpWanted_ || stop_; });
+        if (stop_) return;
+        dumpWanted_ = false;
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
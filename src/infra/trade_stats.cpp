@@ -0,0 +1,117 @@
+#include "trade_stats.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "clock.h"
+
+namespace {
+    void startBar(OhlcvBar& bar, int64_t start_ns, Px price) {
+        bar = OhlcvBar{start_ns, price, price, price, price, 0, 0.0, 0};
+    }
+
+    void addToBar(OhlcvBar& bar, Px price, Qty qty) {
+        bar.high = std::max(bar.high, price);
+        bar.low = std::min(bar.low, price);
+        bar.close = price;
+        bar.volume += qty;
+        bar.notional += price * qty;
+        ++bar.trades;
+    }
+}
+
+TradeStatistics::TradeStatistics(const StatsConfig& config) {
+    // Pin each series to a wall-clock bar boundary once, here, so the strand
+    // buckets fills on raw ticks and never needs the clock calibration
+    int64_t wall = Clock::toWallNanos(Clock::now());
+    for (auto interval : config.bar_intervals) {
+        if (intervals_ == kMaxIntervals) break;
+        if (interval.count() <= 0) continue;
+        Series& series = series_[intervals_++];
+        series.interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+        series.interval_ticks = std::max<uint64_t>(1, Clock::ticksFor(interval));
+        series.origin_ns = wall - wall % series.interval_ns;
+        series.origin_ticks = Clock::fromWallNanos(series.origin_ns).ticks;
+    }
+}
+
+void TradeStatistics::onFill(const Fill& fill) {
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (summary_.trades == 0) {
+        summary_.open = summary_.high = summary_.low = fill.price;
+    }
+    ++summary_.trades;
+    summary_.volume += fill.qty;
+    summary_.notional += fill.price * fill.qty;
+    summary_.high = std::max(summary_.high, fill.price);
+    summary_.low = std::min(summary_.low, fill.price);
+    summary_.last = fill.price;
+    summary_.last_qty = fill.qty;
+    lastTradeTicks_ = fill.ts.ticks;
+
+    for (size_t i = 0; i < intervals_; ++i) {
+        Series& series = series_[i];
+        uint64_t index = fill.ts.ticks > series.origin_ticks ? (fill.ts.ticks - series.origin_ticks) / series.interval_ticks : 0;
+        int64_t bucket = series.origin_ns + static_cast<int64_t>(index) * series.interval_ns;
+        if (series.current.start_ns == 0) {
+            startBar(series.current, bucket, fill.price);
+        } else if (bucket > series.current.start_ns) {
+            series.history[series.completed % kHistory] = series.current;
+            ++series.completed;
+            startBar(series.current, bucket, fill.price);
+        }
+        addToBar(series.current, fill.price, fill.qty);
+    }
+
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+template<class F>
+void TradeStatistics::read(F&& copy) const {
+    while (true) {
+        uint64_t before = seq_.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        copy();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == before) return;
+    }
+}
+
+TradeSummary TradeStatistics::summary() const {
+    TradeSummary out;
+    uint64_t ticks;
+    read([&] {
+        std::memcpy(&out, &summary_, sizeof(out));
+        ticks = lastTradeTicks_;
+    });
+    // Converted here, by the reader, rather than per fill on the strand
+    out.last_trade_ns = ticks ? Clock::toWallNanos(Timestamp{ticks}) : 0;
+    return out;
+}
+
+std::vector<OhlcvBar> TradeStatistics::bars(std::chrono::milliseconds interval, size_t count) const {
+    int64_t interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    auto it = std::find_if(series_.begin(), series_.begin() + intervals_,
+                           [interval_ns](const Series& s) { return s.interval_ns == interval_ns; });
+    if (it == series_.begin() + intervals_ || count == 0) return {};
+
+    // Copied whole (a few KB) so the reader holds the seqlock only briefly
+    Series series;
+    read([&] { std::memcpy(&series, &*it, sizeof(series)); });
+    if (series.current.start_ns == 0) return {};
+
+    size_t kept = std::min<uint64_t>(series.completed, kHistory);
+    size_t from_history = std::min(kept, count - 1);
+    std::vector<OhlcvBar> out;
+    out.reserve(from_history + 1);
+    for (uint64_t n = series.completed - from_history; n < series.completed; ++n) {
+        out.push_back(series.history[n % kHistory]);
+    }
+    out.push_back(series.current);
+    return out;
+}
@@ -0,0 +1,303 @@
+#include "trade_store.h"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "clock.h"
+
+using trade_store::IndexEntry;
+using trade_store::kBlockRows;
+
+namespace {
+    constexpr int64_t kNanosPerDay = 86400LL * 1000000000LL;
+
+    enum Column { TS, PRICE, QTY, TAKER, MAKER, SIDE, kColumns };
+
+    constexpr std::array<const char*, kColumns> kColumnNames{"ts.col", "price.col", "qty.col",
+                                                             "taker.col", "maker.col", "side.col"};
+    constexpr std::array<size_t, kColumns> kColumnWidths{sizeof(uint32_t), sizeof(Px), sizeof(Qty),
+                                                         sizeof(OrdId), sizeof(OrdId), sizeof(uint8_t)};
+
+    bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    off_t fileSize(int fd) {
+        struct stat st;
+        return ::fstat(fd, &st) == 0 ? st.st_size : 0;
+    }
+
+    // Whole file, read-only; null for an empty or missing one
+    std::shared_ptr<const void> mapFile(const std::string& path, size_t& size) {
+        size = 0;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+        size = static_cast<size_t>(fileSize(fd));
+        void* data = size ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            size = 0;
+            return nullptr;
+        }
+        ::madvise(data, size, MADV_SEQUENTIAL);
+        return std::shared_ptr<const void>(data, [size](const void* p) { ::munmap(const_cast<void*>(p), size); });
+    }
+
+    template<class T>
+    void put(std::vector<char>& buffer, const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+}
+
+int64_t trade_store::dayOf(int64_t wall_ns) {
+    int64_t day = wall_ns / kNanosPerDay;
+    return (wall_ns % kNanosPerDay < 0) ? day - 1 : day;
+}
+
+std::string trade_store::partitionPath(const std::string& root, const std::string& symbol, int64_t day) {
+    std::chrono::year_month_day date{std::chrono::sys_days{std::chrono::days{day}}};
+    char name[16];
+    std::snprintf(name, sizeof(name), "%04d%02u%02u", static_cast<int>(date.year()),
+                  static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()));
+    return (std::filesystem::path(root) / symbol / name).string();
+}
+
+struct TradeStoreWriter::Partition {
+    int64_t day;
+    std::string path;
+    std::array<int, kColumns> fds;
+    std::array<std::vector<char>, kColumns> pending;
+    int indexFd{-1};
+    std::vector<IndexEntry> blocks;  // the whole day's index; tiny next to the columns
+    size_t dirtyFrom{0};             // first entry not yet written as it stands
+    bool blockOpen{false};           // the last entry can still take rows
+    uint64_t rows{0};
+    int64_t last_ns{INT64_MIN};
+    bool ok{true};
+
+    Partition(const std::string& root, const std::string& symbol, int64_t d);
+    ~Partition();
+
+    void append(const TradeLog& trade, int64_t wall_ns);
+    bool flush(bool sync);
+};
+
+TradeStoreWriter::Partition::Partition(const std::string& root, const std::string& symbol, int64_t d)
+    : day(d), path(trade_store::partitionPath(root, symbol, d)) {
+    fds.fill(-1);
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+    for (size_t c = 0; c < kColumns; ++c) {
+        fds[c] = ::open((path + "/" + kColumnNames[c]).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    indexFd = ::open((path + "/index.bin").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    for (int fd : fds) ok = ok && fd >= 0;
+    ok = ok && indexFd >= 0;
+    if (!ok) {
+        std::cerr << "Error: failed to open trade store partition " << path << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    // Reopening a day already written (a restart): keep only the rows that
+    // every column and the index agree on, then start a fresh block
+    blocks.resize(static_cast<size_t>(fileSize(indexFd)) / sizeof(IndexEntry));
+    if (!blocks.empty() &&
+        ::pread(indexFd, blocks.data(), blocks.size() * sizeof(IndexEntry), 0) !=
+            static_cast<ssize_t>(blocks.size() * sizeof(IndexEntry))) {
+        blocks.clear();
+    }
+    rows = blocks.empty() ? 0 : blocks.back().first_row + blocks.back().rows;
+    for (size_t c = 0; c < kColumns; ++c) {
+        rows = std::min<uint64_t>(rows, static_cast<uint64_t>(fileSize(fds[c])) / kColumnWidths[c]);
+    }
+    while (!blocks.empty() && blocks.back().first_row >= rows) blocks.pop_back();
+    if (!blocks.empty()) {
+        blocks.back().rows = static_cast<uint32_t>(rows - blocks.back().first_row);
+        last_ns = blocks.back().last_ns;
+    }
+    for (size_t c = 0; c < kColumns; ++c) {
+        if (::ftruncate(fds[c], static_cast<off_t>(rows * kColumnWidths[c])) != 0) ok = false;
+    }
+    if (::ftruncate(indexFd, static_cast<off_t>(blocks.size() * sizeof(IndexEntry))) != 0) ok = false;
+    dirtyFrom = blocks.empty() ? 0 : blocks.size() - 1;
+}
+
+TradeStoreWriter::Partition::~Partition() {
+    for (int fd : fds) {
+        if (fd >= 0) ::close(fd);
+    }
+    if (indexFd >= 0) ::close(indexFd);
+}
+
+void TradeStoreWriter::Partition::append(const TradeLog& trade, int64_t wall_ns) {
+    // Rows stay in time order even if the wall clock steps back
+    wall_ns = std::max(wall_ns, last_ns);
+    if (!blockOpen || blocks.back().rows == kBlockRows || wall_ns - blocks.back().base_ns > UINT32_MAX) {
+        blocks.push_back(IndexEntry{wall_ns, wall_ns, rows, 0, 0});
+        blockOpen = true;
+    }
+    IndexEntry& block = blocks.back();
+    put(pending[TS], static_cast<uint32_t>(wall_ns - block.base_ns));
+    put(pending[PRICE], trade.fill.price);
+    put(pending[QTY], trade.fill.qty);
+    put(pending[TAKER], trade.fill.taker_id);
+    put(pending[MAKER], trade.fill.maker_id);
+    put(pending[SIDE], static_cast<uint8_t>(trade.fill.taker_is_buy));
+    block.last_ns = wall_ns;
+    ++block.rows;
+    ++rows;
+    last_ns = wall_ns;
+}
+
+bool TradeStoreWriter::Partition::flush(bool sync) {
+    // A partition that failed to open was reported then and takes no rows
+    if (!ok || pending[TS].empty()) return true;
+
+    // Columns before the index, so a reader never sees rows the columns lack
+    for (size_t c = 0; c < kColumns; ++c) {
+        if (!writeAll(fds[c], pending[c].data(), pending[c].size())) return false;
+        pending[c].clear();
+    }
+    if (sync) {
+        for (int fd : fds) {
+            if (::fdatasync(fd) != 0) return false;
+        }
+    }
+    size_t bytes = (blocks.size() - dirtyFrom) * sizeof(IndexEntry);
+    if (::pwrite(indexFd, blocks.data() + dirtyFrom, bytes,
+                 static_cast<off_t>(dirtyFrom * sizeof(IndexEntry))) != static_cast<ssize_t>(bytes)) {
+        return false;
+    }
+    if (sync && ::fdatasync(indexFd) != 0) return false;
+    // The open block is rewritten as it grows
+    dirtyFrom = blockOpen ? blocks.size() - 1 : blocks.size();
+    if (blockOpen && blocks.back().rows == kBlockRows) dirtyFrom = blocks.size();
+    return true;
+}
+
+TradeStoreWriter::TradeStoreWriter(std::string root) : root_(std::move(root)) {}
+
+TradeStoreWriter::~TradeStoreWriter() {
+    flush(false);
+}
+
+void TradeStoreWriter::append(const TradeLog& trade) {
+    int64_t wall = Clock::toWallNanos(trade.fill.ts);
+    Partition* partition = partitionFor(trade.symbol, trade_store::dayOf(wall));
+    if (partition->ok) {
+        partition->append(trade, wall);
+    }
+}
+
+bool TradeStoreWriter::flush(bool sync) {
+    bool ok = true;
+    for (auto& [symbol, partition] : partitions_) {
+        if (!partition->flush(sync)) {
+            std::cerr << "Error: trade store write failed in " << partition->path << ": " << std::strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+TradeStoreWriter::Partition* TradeStoreWriter::partitionFor(const std::string& symbol, int64_t day) {
+    auto it = partitions_.find(symbol);
+    if (it != partitions_.end() && it->second->day >= day) {
+        // A late trade from the day before stays in the current partition
+        return it->second.get();
+    }
+    if (it != partitions_.end()) {
+        it->second->flush(false);
+    }
+    auto partition = std::make_unique<Partition>(root_, symbol, day);
+    Partition* raw = partition.get();
+    partitions_[symbol] = std::move(partition);
+    return raw;
+}
+
+std::optional<TradePartition> TradePartition::open(const std::string& root, const std::string& symbol, int64_t day) {
+    std::string path = trade_store::partitionPath(root, symbol, day);
+    TradePartition partition;
+
+    size_t indexBytes;
+    auto index = mapFile(path + "/index.bin", indexBytes);
+    if (!index) return std::nullopt;
+    partition.index_ = static_cast<const IndexEntry*>(index.get());
+    partition.blocks_ = indexBytes / sizeof(IndexEntry);
+    partition.mappings_.push_back(std::move(index));
+    if (partition.blocks_ == 0) return std::nullopt;
+
+    const IndexEntry& last = partition.index_[partition.blocks_ - 1];
+    partition.rows_ = last.first_row + last.rows;
+    std::array<const void*, kColumns> columns{};
+    for (size_t c = 0; c < kColumns; ++c) {
+        size_t bytes;
+        auto column = mapFile(path + "/" + kColumnNames[c], bytes);
+        // The writer may be mid-append: only rows every column holds count
+        partition.rows_ = std::min(partition.rows_, bytes / kColumnWidths[c]);
+        columns[c] = column.get();
+        if (column) partition.mappings_.push_back(std::move(column));
+    }
+    if (partition.rows_ == 0) return std::nullopt;
+
+    partition.ts_ = static_cast<const uint32_t*>(columns[TS]);
+    partition.price_ = static_cast<const Px*>(columns[PRICE]);
+    partition.qty_ = static_cast<const Qty*>(columns[QTY]);
+    partition.taker_ = static_cast<const OrdId*>(columns[TAKER]);
+    partition.maker_ = static_cast<const OrdId*>(columns[MAKER]);
+    partition.side_ = static_cast<const uint8_t*>(columns[SIDE]);
+    return partition;
+}
+
+std::vector<TradeRow> TradeHistory::trades(const std::string& symbol, int64_t from_ns, int64_t to_ns) const {
+    std::vector<TradeRow> out;
+    scan(symbol, from_ns, to_ns, [&out](const TradeRow& row) { out.push_back(row); });
+    return out;
+}
+
+TradeAggregate TradeHistory::aggregate(const std::string& symbol, int64_t from_ns, int64_t to_ns) const {
+    TradeAggregate out;
+    forEachPartition(symbol, from_ns, to_ns, [&](const TradePartition& p) {
+        p.forEachBlock(from_ns, to_ns, [&](const IndexEntry&, size_t first, size_t last) {
+            // Only the price and quantity columns are touched
+            const Px* price = p.prices();
+            const Qty* qty = p.quantities();
+            if (out.trades == 0) out.first = out.high = out.low = price[first];
+            uint64_t volume = 0;
+            double notional = 0;
+            Px high = out.high;
+            Px low = out.low;
+            for (size_t row = first; row < last; ++row) {
+                volume += qty[row];
+                notional += price[row] * qty[row];
+                high = std::max(high, price[row]);
+                low = std::min(low, price[row]);
+            }
+            out.trades += last - first;
+            out.volume += volume;
+            out.notional += notional;
+            out.high = high;
+            out.low = low;
+            out.last = price[last - 1];
+        });
+    });
+    return out;
+}
@@ -0,0 +1,94 @@
+#include "wire_protocol.h"
+#include <algorithm>
+
+namespace wire {
+
+namespace {
+    template<class T>
+    void append(std::vector<char>& out, const T& value) {
+        size_t at = out.size();
+        out.resize(at + sizeof(T));
+        std::memcpy(out.data() + at, &value, sizeof(T));
+    }
+
+    template<class Request>
+    DecodedRequest decoded(uint32_t symbol, uint64_t request_id, Request&& request) {
+        request.request_id = request_id;
+        return DecodedRequest{symbol, TradingRequest(std::forward<Request>(request))};
+    }
+}
+
+std::optional<DecodedRequest> decode_request(const char* data, size_t length, const ClientId& client) {
+    const auto* hdr = view<Header>(data, length);
+    if (!hdr) return std::nullopt;
+
+    switch (hdr->type) {
+        case MsgType::NEW_ORDER: {
+            const auto* msg = view<NewOrder>(data, length);
+            if (!msg || msg->side > 1 || msg->tif > 2) return std::nullopt;
+            NewOrderParams params{
+                .id = msg->order_id,
+                .client = client,
+                .side = static_cast<Side>(msg->side),
+                .qty = msg->quantity,
+                .tif = static_cast<TimeInForce>(msg->tif)
+            };
+            // Packed fields are copied out by value; they may be misaligned
+            if (msg->flags & kHasPrice) params.price = Px{msg->price};
+            if (msg->flags & kHasStopPrice) params.stop_price = Px{msg->stop_price};
+            if (msg->flags & kHasDisplayQty) params.display_qty = Qty{msg->display_quantity};
+            if (params.tif == TimeInForce::GTD) params.expire_at = Clock::fromWallNanos(msg->expire_at_ns);
+
+            auto kind = msg->order_type < kOrderKindCount ? OrderKind{msg->order_type} : kInvalidOrderKind;
+            return decoded(msg->symbol_id, msg->request_id, NewOrderRequest(Symb{}, kind, std::move(params)));
+        }
+        case MsgType::CANCEL: {
+            const auto* msg = view<Cancel>(data, length);
+            if (!msg) return std::nullopt;
+            return decoded(msg->symbol_id, msg->request_id, CancelOrderRequest(Symb{}, msg->order_id, client));
+        }
+        case MsgType::MODIFY: {
+            const auto* msg = view<Modify>(data, length);
+            if (!msg) return std::nullopt;
+            return decoded(msg->symbol_id, msg->request_id,
+                           ModifyOrderRequest(Symb{}, msg->order_id, msg->price, msg->quantity, client));
+        }
+        case MsgType::MASS_CANCEL: {
+            const auto* msg = view<MassCancel>(data, length);
+            if (!msg || msg->side > kBothSides) return std::nullopt;
+            std::optional<Side> side;
+            if (msg->side != kBothSides) side = static_cast<Side>(msg->side);
+            std::optional<ClientId> owner;
+            if (msg->own_orders) owner = client;
+            return decoded(msg->symbol_id, msg->request_id, MassCancelRequest(Symb{}, std::move(owner), side));
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+void encode_report(std::vector<char>& out, const RequestOutcome& outcome, size_t max_fills) {
+    // Split across reports when the fills don't fit one
+    max_fills = std::clamp<size_t>(max_fills, 1, UINT16_MAX);
+    size_t sent = 0;
+    do {
+        size_t count = std::min(outcome.fills.size() - sent, max_fills);
+        ExecReport report{
+            .hdr = header_for<ExecReport>(MsgType::EXEC_REPORT, count * sizeof(ExecFill)),
+            .request_id = outcome.request_id,
+            .status = static_cast<uint8_t>(outcome.status),
+            .reason = static_cast<uint8_t>(outcome.reason),
+            .fill_count = static_cast<uint16_t>(count),
+            .filled_qty = outcome.taker_filled_qty,
+            .remaining_qty = outcome.taker_remaining_qty
+        };
+        append(out, report);
+        for (size_t i = sent; i < sent + count; ++i) {
+            const Fill& fill = outcome.fills[i];
+            append(out, ExecFill{fill.maker_id, fill.price, fill.qty, 0});
+        }
+        sent += count;
+    } while (sent < outcome.fills.size());
+}
+
+} // namespace wire
@@ -0,0 +1,88 @@
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include "csv_loader.h"
+#include "exchange.h"
+
+namespace {
+    // Counter deltas per process_request call, summed over shards
+    void printPerfReport(const Exchange::Stats& stats) {
+        std::array<PerfTotals, kRequestTypes> totals{};
+        bool counted = false;
+        for (const auto& shard : stats.shards) {
+            counted = counted || shard.perf_counters;
+            for (size_t t = 0; t < kRequestTypes; ++t) totals[t] += shard.perf[t];
+        }
+        if (!counted) {
+            std::cout << "Perf counters unavailable" << std::endl;
+            return;
+        }
+        std::cout << std::left << std::setw(14) << "request" << std::right << std::setw(10) << "calls";
+        for (auto name : kPerfEventNames) std::cout << std::setw(15) << name;
+        std::cout << std::setw(8) << "ipc" << std::endl;
+        std::cout << std::fixed << std::setprecision(1);
+        for (size_t t = 0; t < kRequestTypes; ++t) {
+            if (totals[t].calls == 0) continue;
+            std::cout << std::left << std::setw(14) << kRequestTypeNames[t] << std::right << std::setw(10) << totals[t].calls;
+            for (size_t e = 0; e < kPerfEvents; ++e) std::cout << std::setw(15) << totals[t].perCall(static_cast<PerfEvent>(e));
+            std::cout << std::setw(8) << std::setprecision(2) << totals[t].ipc() << std::setprecision(1) << std::endl;
+        }
+        std::cout << std::defaultfloat;
+    }
+}
+
+// Replays an order flow CSV: usage <csv> [symbol] [--perf]
+int main(int argc, char** argv) {
+    std::vector<std::string_view> args;
+    bool perf = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view(argv[i]) == "--perf") {
+            perf = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.empty()) {
+        std::cerr << "usage: " << argv[0] << " <orders.csv> [symbol] [--perf]" << std::endl;
+        return 1;
+    }
+    Symb symbol = args.size() > 1 ? Symb(args[1]) : "SIM";
+
+    // A replay wants every request matched: wait for queue room instead of shedding
+    Exchange exchange({symbol}, std::thread::hardware_concurrency(), {}, ShardConfig{.perf_counters = perf},
+                      AdmissionConfig{.policy = OverloadPolicy::BLOCK, .max_block = std::chrono::hours(1)});
+    CsvLoader loader(CsvLoader::Options{.symbol = symbol, .symbol_id = *exchange.symbolId(symbol)});
+
+    LoadResult loaded;
+    try {
+        loaded = loader.load(std::string(args[0]));
+    } catch (const std::system_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Loaded " << loaded.requests.size() << " requests (" << loaded.bad_rows << " bad rows) from "
+              << static_cast<double>(loaded.bytes) / 1e6 << " MB in " << loaded.seconds << " s, "
+              << loaded.mbPerSecond() << " MB/s" << std::endl;
+
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> throttled{0};
+    auto started = std::chrono::steady_clock::now();
+    for (auto& loaded_request : loaded.requests) {
+        exchange.submitRequest(loaded_request.symbol, std::move(loaded_request.request),
+                               [&done, &throttled](RequestOutcome&& outcome) {
+                                   if (outcome.reason == RejectReason::THROTTLED) throttled.fetch_add(1, std::memory_order_relaxed);
+                                   done.fetch_add(1, std::memory_order_release);
+                               });
+    }
+    while (done.load(std::memory_order_acquire) < loaded.requests.size()) std::this_thread::yield();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Replayed " << loaded.requests.size() << " requests in " << seconds << " s, "
+              << static_cast<double>(loaded.requests.size()) / seconds << " requests/s, "
+              << throttled.load(std::memory_order_relaxed) << " throttled" << std::endl;
+    if (perf) printPerfReport(exchange.stats());
+
+    exchange.shutdown();
+    return 0;
+}